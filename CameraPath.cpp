@@ -0,0 +1,68 @@
+#include "CameraPath.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+CameraPath::CameraPath() {
+
+}
+
+bool CameraPath::Load(const std::filesystem::path& path) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cout << "Could not open camera path " << path << "\n";
+        return false;
+    }
+    keyframes.clear();
+    std::string line;
+    for (uint32_t lineNumber = 1; std::getline(file, line); lineNumber++) {
+        const size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#')
+            continue;
+        std::istringstream stream(line);
+        CameraKeyframe keyframe;
+        if (!(stream >> keyframe.time >> keyframe.position.x >> keyframe.position.y >> keyframe.position.z >> keyframe.yaw >> keyframe.pitch)) {
+            std::cout << "Camera path " << path << " line " << lineNumber << ": expected time x y z yaw pitch\n";
+            return false;
+        }
+        if (!keyframes.empty() && keyframe.time < keyframes.back().time) {
+            std::cout << "Camera path " << path << " line " << lineNumber << ": keyframes are not sorted by time\n";
+            return false;
+        }
+        keyframes.emplace_back(keyframe);
+    }
+    if (keyframes.empty()) {
+        std::cout << "Camera path " << path << " has no keyframes\n";
+        return false;
+    }
+    std::cout << "Loaded camera path " << path << ", " << keyframes.size() << " keyframes over " << GetDuration() << " s\n";
+    return true;
+}
+
+float CameraPath::GetDuration() {
+    return keyframes.empty() ? 0 : keyframes.back().time - keyframes.front().time;
+}
+
+CameraKeyframe CameraPath::Sample(float time) {
+    if (keyframes.empty())
+        return CameraKeyframe{ time, glm::vec3(0), 0, 0 };
+    // Times are relative to the first keyframe, so a path may start anywhere.
+    time += keyframes.front().time;
+    const auto next = std::upper_bound(keyframes.begin(), keyframes.end(), time, [](float t, const CameraKeyframe& k) { return t < k.time; });
+    if (next == keyframes.begin())
+        return keyframes.front();
+    if (next == keyframes.end())
+        return keyframes.back();
+    const auto& a = *(next - 1);
+    const auto& b = *next;
+    const float t = b.time > a.time ? (time - a.time) / (b.time - a.time) : 1;
+    return CameraKeyframe{
+        time,
+        glm::mix(a.position, b.position, t),
+        glm::mix(a.yaw, b.yaw, t),
+        glm::mix(a.pitch, b.pitch, t)
+    };
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#define GLM_FORCE_SWIZZLE
+
+#include <glm/glm.hpp>
+
+#include <filesystem>
+#include <vector>
+
+// Camera pose at a point in time, yaw and pitch in degrees like the renderer's.
+struct CameraKeyframe {
+	float time;
+	glm::vec3 position;
+	float yaw;
+	float pitch;
+};
+
+// Camera flight loaded from a text file, replayed at fixed timesteps so every run renders the same frames.
+class CameraPath
+{
+public:
+	CameraPath();
+
+	// One keyframe per line: time in seconds, position x y z, yaw, pitch. Empty lines and lines starting with # are skipped.
+	// Keyframes have to be sorted by time.
+	bool Load(const std::filesystem::path& path);
+	float GetDuration();
+	// Linear between the surrounding keyframes, held at the first and last one outside the path.
+	CameraKeyframe Sample(float time);
+
+private:
+	std::vector<CameraKeyframe> keyframes;
+};
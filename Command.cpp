@@ -4,7 +4,7 @@ Command::Command() {
 
 }
 
-Command::Command(Device& device, uint32_t cmdBufferCount) {
+Command::Command(Device& device, uint32_t cmdBufferCount, uint32_t threadCount) {
     pDevice = &device.device;
 
     // Command buffer allocation.
@@ -20,11 +20,28 @@ Command::Command(Device& device, uint32_t cmdBufferCount) {
     auto cmdBuffers = device.device.allocateCommandBuffers(allocInfo);
 
     cmdBuffer = cmdBuffers;
+
+    // Secondary pools are reset whole each frame, so they never reset single buffers.
+    vk::CommandPoolCreateInfo threadPoolInfo = vk::CommandPoolCreateInfo()
+        .setQueueFamilyIndex(device.graphicsQueueFamilyIndex)
+        .setFlags(vk::CommandPoolCreateFlagBits::eTransient);
+    threadPools.resize(cmdBufferCount);
+    for (auto& frame : threadPools) {
+        frame.resize(threadCount);
+        for (auto& thread : frame)
+            thread.pool = device.device.createCommandPool(threadPoolInfo);
+    }
 }
 
 void Command::TransitionImage(vk::Image& image, vk::ImageSubresourceRange& subresourceRange,
                               vk::ImageLayout oldLayout, vk::ImageLayout newLayout,
                               vk::AccessFlags2 srcMask, vk::AccessFlags2 dstMask) {
+    TransitionImage(cmdBuffer[currentFrame], image, subresourceRange, oldLayout, newLayout, srcMask, dstMask);
+}
+
+void Command::TransitionImage(vk::CommandBuffer& cmd, vk::Image& image, vk::ImageSubresourceRange& subresourceRange,
+                              vk::ImageLayout oldLayout, vk::ImageLayout newLayout,
+                              vk::AccessFlags2 srcMask, vk::AccessFlags2 dstMask) {
     auto imageMemoryBarrier = vk::ImageMemoryBarrier2()
         .setImage(image)
         .setSubresourceRange(subresourceRange)
@@ -40,38 +57,61 @@ void Command::TransitionImage(vk::Image& image, vk::ImageSubresourceRange& subre
         .setImageMemoryBarrierCount(1)
         .setPImageMemoryBarriers(&imageMemoryBarrier);
 
-    cmdBuffer[currentFrame].pipelineBarrier2(depencyInfo);
+    cmd.pipelineBarrier2(depencyInfo);
 }
 
 void Command::SetDynamicStates(vk::detail::DispatchLoaderDynamic& dldid) {
-    cmdBuffer[currentFrame].setRasterizerDiscardEnable(vk::False);
-    cmdBuffer[currentFrame].setDepthTestEnable(vk::False);
-    cmdBuffer[currentFrame].setDepthWriteEnable(vk::False);
-    cmdBuffer[currentFrame].setDepthCompareOp(vk::CompareOp::eAlways);
-    cmdBuffer[currentFrame].setStencilTestEnable(vk::False);
-    cmdBuffer[currentFrame].setDepthClampEnableEXT(vk::False, dldid);
-    cmdBuffer[currentFrame].setDepthBiasEnable(vk::False);
-    cmdBuffer[currentFrame].setPolygonModeEXT(vk::PolygonMode::eFill, dldid);
-    cmdBuffer[currentFrame].setRasterizationSamplesEXT(vk::SampleCountFlagBits::e1, dldid);
+    SetDynamicStates(cmdBuffer[currentFrame], dldid);
+}
+
+void Command::SetDynamicStates(vk::CommandBuffer& cmd, vk::detail::DispatchLoaderDynamic& dldid) {
+    cmd.setRasterizerDiscardEnable(vk::False);
+    cmd.setDepthTestEnable(vk::False);
+    cmd.setDepthWriteEnable(vk::False);
+    cmd.setDepthCompareOp(vk::CompareOp::eAlways);
+    cmd.setStencilTestEnable(vk::False);
+    cmd.setDepthClampEnableEXT(vk::False, dldid);
+    cmd.setDepthBiasEnable(vk::False);
+    cmd.setPolygonModeEXT(vk::PolygonMode::eFill, dldid);
+    cmd.setRasterizationSamplesEXT(vk::SampleCountFlagBits::e1, dldid);
     uint32_t sampleMask = 1;
-    cmdBuffer[currentFrame].setSampleMaskEXT(vk::SampleCountFlagBits::e1, sampleMask, dldid);
-    cmdBuffer[currentFrame].setAlphaToCoverageEnableEXT(0, dldid);
-    cmdBuffer[currentFrame].setCullMode(vk::CullModeFlagBits::eNone);
-    cmdBuffer[currentFrame].setFrontFace(vk::FrontFace::eClockwise);
-    cmdBuffer[currentFrame].setPrimitiveTopology(vk::PrimitiveTopology::eTriangleList);
+    cmd.setSampleMaskEXT(vk::SampleCountFlagBits::e1, sampleMask, dldid);
+    cmd.setAlphaToCoverageEnableEXT(0, dldid);
+    cmd.setCullMode(vk::CullModeFlagBits::eNone);
+    cmd.setFrontFace(vk::FrontFace::eClockwise);
+    cmd.setPrimitiveTopology(vk::PrimitiveTopology::eTriangleList);
 
-    cmdBuffer[currentFrame].setPrimitiveRestartEnable(0);
+    cmd.setPrimitiveRestartEnable(0);
     uint32_t colorBlendEnable = 1;
-    cmdBuffer[currentFrame].setColorBlendEnableEXT(0, colorBlendEnable, dldid);
-    cmdBuffer[currentFrame].setColorWriteMaskEXT(0, vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG
+    cmd.setColorBlendEnableEXT(0, colorBlendEnable, dldid);
+    cmd.setColorWriteMaskEXT(0, vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG
         | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA, dldid);
     auto colorBlendEquation = vk::ColorBlendEquationEXT()
         .setColorBlendOp(vk::BlendOp::eAdd)
         .setDstColorBlendFactor(vk::BlendFactor::eZero)
         .setSrcColorBlendFactor(vk::BlendFactor::eOne);
-    cmdBuffer[currentFrame].setColorBlendEquationEXT(0, colorBlendEquation, dldid);
+    cmd.setColorBlendEquationEXT(0, colorBlendEquation, dldid);
 }
 
 void Command::SetCurrentFrame(uint32_t frame) {
     currentFrame = frame;
+}
+
+vk::CommandBuffer Command::GetSecondary(uint32_t frame, uint32_t thread) {
+    auto& threadPool = threadPools[frame][thread];
+    if (threadPool.used == threadPool.buffers.size()) {
+        vk::CommandBufferAllocateInfo allocInfo = vk::CommandBufferAllocateInfo()
+            .setCommandBufferCount(1)
+            .setCommandPool(threadPool.pool)
+            .setLevel(vk::CommandBufferLevel::eSecondary);
+        threadPool.buffers.emplace_back(pDevice->allocateCommandBuffers(allocInfo)[0]);
+    }
+    return threadPool.buffers[threadPool.used++];
+}
+
+void Command::ResetThreadPools(uint32_t frame) {
+    for (auto& threadPool : threadPools[frame]) {
+        pDevice->resetCommandPool(threadPool.pool);
+        threadPool.used = 0;
+    }
 }
\ No newline at end of file
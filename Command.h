@@ -6,18 +6,38 @@ class Command
 {
 public:
 	Command();
-	Command(Device& device, uint32_t cmdBufferCount = 2);
+	// Every frame gets one primary command buffer and a secondary pool per recording thread.
+	Command(Device& device, uint32_t cmdBufferCount = 2, uint32_t threadCount = 1);
 	void Present(vk::PresentInfoKHR info, vk::Queue& queue, vk::Fence& renderFinished);
 	void TransitionImage(vk::Image& image, vk::ImageSubresourceRange& subresourceRange,
 		vk::ImageLayout oldLayout, vk::ImageLayout newLayout,
 		vk::AccessFlags2 dstMask, vk::AccessFlags2 srcMask);
+	// Same, recorded into another command buffer than the current frame's.
+	void TransitionImage(vk::CommandBuffer& cmd, vk::Image& image, vk::ImageSubresourceRange& subresourceRange,
+		vk::ImageLayout oldLayout, vk::ImageLayout newLayout,
+		vk::AccessFlags2 dstMask, vk::AccessFlags2 srcMask);
 	void SetDynamicStates(vk::detail::DispatchLoaderDynamic& dldid);
+	void SetDynamicStates(vk::CommandBuffer& cmd, vk::detail::DispatchLoaderDynamic& dldid);
 	void SetCurrentFrame(uint32_t frame);
 
+	// Secondary command buffer from the pool of this frame and thread, only the owning thread may call it.
+	// It stays valid until the frame's pools are reset.
+	vk::CommandBuffer GetSecondary(uint32_t frame, uint32_t thread);
+	// The last submit of the frame has to be finished.
+	void ResetThreadPools(uint32_t frame);
+
 	std::vector<vk::CommandBuffer> cmdBuffer;
 	vk::CommandPool cmdPool;
 private:
+	struct ThreadPool {
+		vk::CommandPool pool;
+		std::vector<vk::CommandBuffer> buffers;
+		uint32_t used = 0;
+	};
+
 	vk::Device* pDevice;
 	uint32_t currentFrame = 0;
+	// Indexed by frame, then thread.
+	std::vector<std::vector<ThreadPool>> threadPools;
 };
 
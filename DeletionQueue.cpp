@@ -0,0 +1,77 @@
+#include "DeletionQueue.h"
+
+#include <algorithm>
+
+DeletionQueue::DeletionQueue() {
+
+}
+
+DeletionQueue::DeletionQueue(vk::Device device, VmaAllocator allocator) : device(device), allocator(allocator) {
+
+}
+
+void DeletionQueue::PushBuffer(uint64_t timelineValue, vk::Buffer buffer, VmaAllocation alloc) {
+    Entry entry = { timelineValue, Type::eBuffer };
+    entry.buffer = buffer;
+    entry.alloc  = alloc;
+    entries.emplace_back(std::move(entry));
+}
+
+void DeletionQueue::PushImage(uint64_t timelineValue, vk::Image image, vk::ImageView view, VmaAllocation alloc) {
+    Entry entry = { timelineValue, Type::eImage };
+    entry.image = image;
+    entry.view  = view;
+    entry.alloc = alloc;
+    entries.emplace_back(std::move(entry));
+}
+
+void DeletionQueue::PushImageView(uint64_t timelineValue, vk::ImageView view) {
+    Entry entry = { timelineValue, Type::eImageView };
+    entry.view = view;
+    entries.emplace_back(std::move(entry));
+}
+
+void DeletionQueue::PushSampler(uint64_t timelineValue, vk::Sampler sampler) {
+    Entry entry = { timelineValue, Type::eSampler };
+    entry.sampler = sampler;
+    entries.emplace_back(std::move(entry));
+}
+
+void DeletionQueue::PushCallback(uint64_t timelineValue, std::function<void()> callback) {
+    Entry entry = { timelineValue, Type::eCallback };
+    entry.callback = std::move(callback);
+    entries.emplace_back(std::move(entry));
+}
+
+uint32_t DeletionQueue::Flush(uint64_t completedValue) {
+    // Finished entries move to the back in push order, so callbacks run in the order they were queued.
+    auto finished = std::stable_partition(entries.begin(), entries.end(), [&](const Entry& e) { return e.timelineValue > completedValue; });
+    const uint32_t count = static_cast<uint32_t>(entries.end() - finished);
+    for (auto it = finished; it != entries.end(); it++) {
+        switch (it->type) {
+        case Type::eBuffer:
+            vmaDestroyBuffer(allocator, it->buffer, it->alloc);
+            break;
+        case Type::eImage:
+            if (it->view)
+                device.destroyImageView(it->view);
+            vmaDestroyImage(allocator, it->image, it->alloc);
+            break;
+        case Type::eImageView:
+            device.destroyImageView(it->view);
+            break;
+        case Type::eSampler:
+            device.destroySampler(it->sampler);
+            break;
+        case Type::eCallback:
+            it->callback();
+            break;
+        }
+    }
+    entries.erase(finished, entries.end());
+    return count;
+}
+
+size_t DeletionQueue::GetPendingCount() {
+    return entries.size();
+}
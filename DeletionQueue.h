@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <vma/vk_mem_alloc.h>
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// GPU objects waiting for the graphics timeline to pass the last submit that used them.
+// Nothing is destroyed on push, Flush destroys everything the GPU is done with in one batch.
+class DeletionQueue
+{
+public:
+	DeletionQueue();
+	DeletionQueue(vk::Device device, VmaAllocator allocator);
+
+	void PushBuffer(uint64_t timelineValue, vk::Buffer buffer, VmaAllocation alloc);
+	// Also destroys the view when one is given.
+	void PushImage(uint64_t timelineValue, vk::Image image, vk::ImageView view, VmaAllocation alloc);
+	void PushImageView(uint64_t timelineValue, vk::ImageView view);
+	void PushSampler(uint64_t timelineValue, vk::Sampler sampler);
+	// For anything that is not a plain handle, like swapchains or table slots. Callbacks must not push themselves.
+	void PushCallback(uint64_t timelineValue, std::function<void()> callback);
+
+	// Destroys everything pushed with a value up to completedValue, returns how many entries that were.
+	uint32_t Flush(uint64_t completedValue);
+	size_t GetPendingCount();
+
+private:
+	enum class Type {
+		eBuffer,
+		eImage,
+		eImageView,
+		eSampler,
+		eCallback
+	};
+	struct Entry {
+		uint64_t timelineValue;
+		Type type;
+		vk::Buffer buffer;
+		vk::Image image;
+		vk::ImageView view;
+		vk::Sampler sampler;
+		VmaAllocation alloc = nullptr;
+		std::function<void()> callback;
+	};
+
+	vk::Device device;
+	VmaAllocator allocator = nullptr;
+	std::vector<Entry> entries;
+};
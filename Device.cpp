@@ -1,12 +1,13 @@
 #include "Device.h"
 
+#include <algorithm>
 #include <iostream>
 
 Device::Device() {
 
 }
 
-Device::Device(vk::Instance& instance) {
+Device::Device(vk::Instance& instance, bool headless) {
     // Create a physical device.
     auto pDevices = instance.enumeratePhysicalDevices();
     physicalDevice = pDevices[0];
@@ -19,7 +20,8 @@ Device::Device(vk::Instance& instance) {
     deviceExtensions.push_back(VK_EXT_MESH_SHADER_EXTENSION_NAME); //
     deviceExtensions.push_back(VK_EXT_SHADER_OBJECT_EXTENSION_NAME); //
     deviceExtensions.push_back(VK_EXT_DYNAMIC_RENDERING_UNUSED_ATTACHMENTS_EXTENSION_NAME); //
-    deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME); //
+    if (!headless)
+        deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME); //
     std::vector<bool> extensionSupported(deviceExtensions.size());
     
     // Query support for main render path extensions.
@@ -42,6 +44,48 @@ Device::Device(vk::Instance& instance) {
                 std::cout << deviceExtensions[i] << std::endl;
     }
 
+    // Present wait is optional, the low latency mode falls back to the timeline without it.
+    auto hasExtension = [&](const char* name) {
+        return std::any_of(physicalExtensions.begin(), physicalExtensions.end(), [&](const vk::ExtensionProperties& e) { return std::strcmp(e.extensionName, name) == 0; });
+    };
+    if (!headless && hasExtension(VK_KHR_PRESENT_ID_EXTENSION_NAME) && hasExtension(VK_KHR_PRESENT_WAIT_EXTENSION_NAME)) {
+        auto supportedPresentWait = vk::PhysicalDevicePresentWaitFeaturesKHR();
+        auto supportedPresentId   = vk::PhysicalDevicePresentIdFeaturesKHR().setPNext(&supportedPresentWait);
+        auto supportedFeatures2   = vk::PhysicalDeviceFeatures2().setPNext(&supportedPresentId);
+        physicalDevice.getFeatures2(&supportedFeatures2);
+        supportsPresentWait = supportedPresentId.presentId && supportedPresentWait.presentWait;
+    }
+    if (supportsPresentWait) {
+        deviceExtensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+        deviceExtensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+    }
+
+    // Core features, block compressed textures, anisotropic filtering and pipeline statistics are optional.
+    auto supportedFeatures = physicalDevice.getFeatures();
+    supportsTextureCompressionBC = supportedFeatures.textureCompressionBC;
+    supportsSamplerAnisotropy    = supportedFeatures.samplerAnisotropy;
+    maxSamplerAnisotropy         = physicalDevice.getProperties().limits.maxSamplerAnisotropy;
+    // The scene is drawn from secondaries, so statistics around it have to be inherited.
+    auto supportedMeshShader = vk::PhysicalDeviceMeshShaderFeaturesEXT();
+    auto supportedFeatures2  = vk::PhysicalDeviceFeatures2().setPNext(&supportedMeshShader);
+    physicalDevice.getFeatures2(&supportedFeatures2);
+    supportsPipelineStatistics = supportedFeatures.pipelineStatisticsQuery && supportedFeatures.inheritedQueries && supportedMeshShader.meshShaderQueries;
+    auto coreFeatures = vk::PhysicalDeviceFeatures()
+        .setTextureCompressionBC(supportsTextureCompressionBC)
+        .setSamplerAnisotropy(supportsSamplerAnisotropy)
+        .setPipelineStatisticsQuery(supportsPipelineStatistics)
+        .setInheritedQueries(supportsPipelineStatistics)
+        .setFragmentStoresAndAtomics(vk::True);
+
+    // Largest update-after-bind texture table, combined image samplers count against both sampler and sampled image limits.
+    auto indexingProperties = vk::PhysicalDeviceDescriptorIndexingProperties();
+    auto properties2 = vk::PhysicalDeviceProperties2().setPNext(&indexingProperties);
+    physicalDevice.getProperties2(&properties2);
+    maxBindlessTextures = std::min({ indexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers,
+                                     indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+                                     indexingProperties.maxDescriptorSetUpdateAfterBindSamplers,
+                                     indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages });
+
     // Chain of configured extension features.
 
     auto vulk12Features = vk::PhysicalDeviceVulkan12Features()
@@ -55,6 +99,10 @@ Device::Device(vk::Instance& instance) {
 
     auto descriptorIndexingFeatures = vk::PhysicalDeviceDescriptorIndexingFeatures()
         .setRuntimeDescriptorArray(vk::True)
+        .setShaderSampledImageArrayNonUniformIndexing(vk::True)
+        .setDescriptorBindingPartiallyBound(vk::True)
+        .setDescriptorBindingSampledImageUpdateAfterBind(vk::True)
+        .setDescriptorBindingUpdateUnusedWhilePending(vk::True)
         .setPNext(&dynamicRenderingFeaturesIMGUI);
     auto bufferDeviceAddressFeatures = vk::PhysicalDeviceBufferDeviceAddressFeatures()
         .setBufferDeviceAddress(vk::True)
@@ -62,9 +110,12 @@ Device::Device(vk::Instance& instance) {
     //auto dynamicRenderingFeatures = vk::PhysicalDeviceDynamicRenderingFeatures()
     //    .setDynamicRendering(vk::True)
     //    .setPNext(&bufferDeviceAddressFeatures);
+    auto timelineSemaphoreFeatures = vk::PhysicalDeviceTimelineSemaphoreFeatures()
+        .setTimelineSemaphore(vk::True)
+        .setPNext(&bufferDeviceAddressFeatures);
     auto sync2Features = vk::PhysicalDeviceSynchronization2Features()
         .setSynchronization2(vk::True)
-        .setPNext(&bufferDeviceAddressFeatures);
+        .setPNext(&timelineSemaphoreFeatures);
     auto shaderObjectFeatures = vk::PhysicalDeviceShaderObjectFeaturesEXT()
         .setShaderObject(vk::True)
         .setPNext(&sync2Features);
@@ -74,7 +125,14 @@ Device::Device(vk::Instance& instance) {
     auto meshShaderFeatures = vk::PhysicalDeviceMeshShaderFeaturesEXT()
         .setMeshShader(vk::True)
         .setTaskShader(vk::True)
+        .setMeshShaderQueries(supportsPipelineStatistics)
         .setPNext(&vulk14Features);
+    auto presentWaitFeatures = vk::PhysicalDevicePresentWaitFeaturesKHR()
+        .setPresentWait(vk::True)
+        .setPNext(&meshShaderFeatures);
+    auto presentIdFeatures = vk::PhysicalDevicePresentIdFeaturesKHR()
+        .setPresentId(vk::True)
+        .setPNext(&presentWaitFeatures);
 
     // Query queues and create infos.
     auto queueFamilyProperties = physicalDevice.getQueueFamilyProperties();
@@ -106,7 +164,8 @@ Device::Device(vk::Instance& instance) {
     vk::DeviceCreateInfo deviceInfo = vk::DeviceCreateInfo()
         .setPEnabledExtensionNames(deviceExtensions)
         .setQueueCreateInfos(deviceQueueInfo)
-        .setPNext(&meshShaderFeatures);
+        .setPEnabledFeatures(&coreFeatures)
+        .setPNext(supportsPresentWait ? static_cast<void*>(&presentIdFeatures) : &meshShaderFeatures);
 
     device = physicalDevice.createDevice(deviceInfo);
 }
\ No newline at end of file
@@ -8,7 +8,8 @@ class Device
 {
 public:
 	Device();
-	Device(vk::Instance& instance);
+	// Headless devices render offscreen only and enable no swapchain extensions.
+	Device(vk::Instance& instance, bool headless = false);
 
 	vk::Device device;
 	vk::PhysicalDevice physicalDevice;
@@ -16,5 +17,14 @@ public:
 	uint32_t graphicsQueueFamilyIndex;
 	uint32_t computeQueueFamilyIndex;
 
+	bool supportsTextureCompressionBC = false;
+	bool supportsSamplerAnisotropy = false;
+	float maxSamplerAnisotropy = 1.0f;
+	uint32_t maxBindlessTextures = 0;
+	// VK_KHR_present_id and VK_KHR_present_wait, lets the CPU wait until a frame is on screen.
+	bool supportsPresentWait = false;
+	// Fragment, task and mesh shader invocation queries, inheritable by secondary command buffers.
+	bool supportsPipelineStatistics = false;
+
 private:
 };
\ No newline at end of file
@@ -0,0 +1,38 @@
+#include "FrameLimiter.h"
+
+#include <algorithm>
+#include <thread>
+
+FrameLimiter::FrameLimiter() {
+    deadline = std::chrono::steady_clock::now();
+}
+
+void FrameLimiter::Wait(double targetFps) {
+    const auto start = std::chrono::steady_clock::now();
+    if (targetFps <= 0) {
+        deadline = start;
+        waitTime = 0;
+        return;
+    }
+    const auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / targetFps));
+    deadline += period;
+    // A frame that ran over by more than a period starts a new schedule instead of rushing to catch up.
+    if (deadline < start - period)
+        deadline = start;
+
+    // Short sleeps, each one refines the overshoot estimate.
+    constexpr auto sleepStep = std::chrono::milliseconds(1);
+    while (deadline - std::chrono::steady_clock::now() > sleepStep + sleepOvershoot) {
+        const auto before = std::chrono::steady_clock::now();
+        std::this_thread::sleep_for(sleepStep);
+        const std::chrono::duration<double> overshoot = std::chrono::steady_clock::now() - before - sleepStep;
+        sleepOvershoot = std::clamp(sleepOvershoot * 0.9 + overshoot * 0.1, std::chrono::duration<double>(0), std::chrono::duration<double>(0.004));
+    }
+    while (std::chrono::steady_clock::now() < deadline)
+        std::this_thread::yield();
+    waitTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+double FrameLimiter::GetWaitTime() {
+    return waitTime;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <chrono>
+
+// Paces frames to a target rate on the CPU, independent of the present mode.
+// Sleeps while the deadline is further away than the scheduler is known to oversleep, and spins for the rest.
+class FrameLimiter
+{
+public:
+	FrameLimiter();
+
+	// Returns once a frame period passed since the last deadline, 0 or less disables the limit.
+	void Wait(double targetFps);
+	// Milliseconds the last Wait held the thread back.
+	double GetWaitTime();
+
+private:
+	std::chrono::steady_clock::time_point deadline;
+	// Running estimate of how much longer than asked a short sleep takes.
+	std::chrono::duration<double> sleepOvershoot = std::chrono::microseconds(500);
+	double waitTime = 0;
+};
@@ -0,0 +1,81 @@
+#include "FrameStats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+
+FrameStats::FrameStats() {
+
+}
+
+void FrameStats::Add(double frameTime) {
+    frameTimes.emplace_back(frameTime);
+}
+
+size_t FrameStats::GetCount() {
+    return frameTimes.size();
+}
+
+double FrameStats::GetMean() {
+    if (frameTimes.empty())
+        return 0;
+    return std::accumulate(frameTimes.begin(), frameTimes.end(), 0.0) / frameTimes.size();
+}
+
+double FrameStats::GetPercentile(double fraction) {
+    if (frameTimes.empty())
+        return 0;
+    std::vector<double> sorted = frameTimes;
+    std::sort(sorted.begin(), sorted.end());
+    return sorted[static_cast<size_t>(std::round(std::clamp(fraction, 0.0, 1.0) * (sorted.size() - 1)))];
+}
+
+void FrameStats::Print() {
+    const double mean = GetMean();
+    std::cout << frameTimes.size() << " frames, mean " << mean << " ms (" << (mean > 0 ? 1000 / mean : 0) << " fps), min " << GetPercentile(0)
+        << " ms, p50 " << GetPercentile(0.5) << " ms, p95 " << GetPercentile(0.95) << " ms, p99 " << GetPercentile(0.99) << " ms, max " << GetPercentile(1) << " ms\n";
+}
+
+bool FrameStats::WriteJson(const std::filesystem::path& path, const std::vector<std::pair<std::string, std::string>>& labels) {
+    std::ofstream file(path);
+    if (!file)
+        return false;
+    file << "{\n";
+    for (const auto& [key, value] : labels)
+        file << "  \"" << EscapeJson(key) << "\": \"" << EscapeJson(value) << "\",\n";
+    WriteSummary(file, "  ");
+    file << ",\n  \"frameTimesMs\": [";
+    for (size_t i = 0; i < frameTimes.size(); i++)
+        file << (i ? ", " : "") << frameTimes[i];
+    file << "]\n}\n";
+    return file.good();
+}
+
+void FrameStats::WriteSummary(std::ostream& out, const std::string& indent) {
+    const double mean = GetMean();
+    out << indent << "\"frames\": " << frameTimes.size() << ",\n";
+    out << indent << "\"meanMs\": " << mean << ",\n";
+    out << indent << "\"fps\": " << (mean > 0 ? 1000 / mean : 0) << ",\n";
+    out << indent << "\"minMs\": " << GetPercentile(0) << ",\n";
+    out << indent << "\"p50Ms\": " << GetPercentile(0.5) << ",\n";
+    out << indent << "\"p95Ms\": " << GetPercentile(0.95) << ",\n";
+    out << indent << "\"p99Ms\": " << GetPercentile(0.99) << ",\n";
+    out << indent << "\"maxMs\": " << GetPercentile(1);
+}
+
+std::string EscapeJson(const std::string& text) {
+    std::ostringstream out;
+    for (const char c : text) {
+        if (c == '"' || c == '\\')
+            out << '\\' << c;
+        else if (static_cast<unsigned char>(c) < 0x20)
+            out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec;
+        else
+            out << c;
+    }
+    return out.str();
+}
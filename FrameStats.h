@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Frame times of a run, summarized for benchmarks.
+class FrameStats
+{
+public:
+	FrameStats();
+
+	void Add(double frameTime);
+	size_t GetCount();
+	double GetMean();
+	// Frame time below which the given fraction (0-1) of frames stay.
+	double GetPercentile(double fraction);
+
+	// One line summary on stdout.
+	void Print();
+	// Summary and every frame time, labels are written as extra string fields.
+	bool WriteJson(const std::filesystem::path& path, const std::vector<std::pair<std::string, std::string>>& labels);
+	// Summary fields of a JSON object, each line indented, without a comma after the last one.
+	void WriteSummary(std::ostream& out, const std::string& indent);
+
+private:
+	std::vector<double> frameTimes;
+};
+
+// Escapes quotes, backslashes and control characters, so the text can be written as a JSON string.
+std::string EscapeJson(const std::string& text);
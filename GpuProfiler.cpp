@@ -0,0 +1,122 @@
+#include "GpuProfiler.h"
+
+#include <algorithm>
+#include <array>
+#include <iostream>
+
+GpuProfiler::GpuProfiler() {
+
+}
+
+GpuProfiler::GpuProfiler(vk::Device device, vk::PhysicalDevice physicalDevice, uint32_t queueFamilyIndex, uint32_t frameCount, bool pipelineStatistics) : device(device) {
+    frames.resize(frameCount);
+    const uint32_t validBits = physicalDevice.getQueueFamilyProperties()[queueFamilyIndex].timestampValidBits;
+    if (validBits == 0) {
+        std::cout << "The graphics queue has no timestamps, GPU times read 0.\n";
+    }
+    else {
+        timestampPeriod = physicalDevice.getProperties().limits.timestampPeriod;
+        timestampMask   = validBits >= 64 ? UINT64_MAX : (1ull << validBits) - 1;
+        auto poolInfo = vk::QueryPoolCreateInfo()
+            .setQueryType(vk::QueryType::eTimestamp)
+            .setQueryCount(frameCount * MAX_GPU_PASSES * 2);
+        timestampPool = device.createQueryPool(poolInfo);
+    }
+    if (!pipelineStatistics) {
+        std::cout << "Pipeline statistics are not supported, shader invocations read 0.\n";
+        return;
+    }
+    // Results come in bit order: fragment, task, mesh.
+    statisticFlags = vk::QueryPipelineStatisticFlagBits::eFragmentShaderInvocations | vk::QueryPipelineStatisticFlagBits::eTaskShaderInvocationsEXT |
+        vk::QueryPipelineStatisticFlagBits::eMeshShaderInvocationsEXT;
+    auto poolInfo = vk::QueryPoolCreateInfo()
+        .setQueryType(vk::QueryType::ePipelineStatistics)
+        .setQueryCount(frameCount * MAX_GPU_PASSES)
+        .setPipelineStatistics(statisticFlags);
+    statisticsPool = device.createQueryPool(poolInfo);
+}
+
+void GpuProfiler::BeginFrame(vk::CommandBuffer& cmd, uint32_t frame) {
+    auto& passes = frames[frame];
+    passes.names.clear();
+    passes.statistics.clear();
+    passes.openPass = UINT32_MAX;
+    passes.recorded = true;
+    if (timestampPool)
+        cmd.resetQueryPool(timestampPool, frame * MAX_GPU_PASSES * 2, MAX_GPU_PASSES * 2);
+    if (statisticsPool)
+        cmd.resetQueryPool(statisticsPool, frame * MAX_GPU_PASSES, MAX_GPU_PASSES);
+}
+
+void GpuProfiler::BeginPass(vk::CommandBuffer& cmd, uint32_t frame, const std::string& name, bool statistics) {
+    auto& passes = frames[frame];
+    if (passes.names.size() == MAX_GPU_PASSES)
+        return;
+    const uint32_t pass = passes.names.size();
+    passes.openPass = pass;
+    passes.names.emplace_back(name);
+    passes.statistics.emplace_back(statistics && statisticsPool);
+    if (timestampPool)
+        cmd.writeTimestamp2(vk::PipelineStageFlagBits2::eTopOfPipe, timestampPool, (frame * MAX_GPU_PASSES + pass) * 2);
+    if (passes.statistics.back())
+        cmd.beginQuery(statisticsPool, frame * MAX_GPU_PASSES + pass, vk::QueryControlFlags());
+}
+
+void GpuProfiler::EndPass(vk::CommandBuffer& cmd, uint32_t frame) {
+    auto& passes = frames[frame];
+    const uint32_t pass = passes.openPass;
+    if (pass == UINT32_MAX)
+        return;
+    passes.openPass = UINT32_MAX;
+    if (timestampPool)
+        cmd.writeTimestamp2(vk::PipelineStageFlagBits2::eAllCommands, timestampPool, (frame * MAX_GPU_PASSES + pass) * 2 + 1);
+    if (passes.statistics[pass])
+        cmd.endQuery(statisticsPool, frame * MAX_GPU_PASSES + pass);
+}
+
+bool GpuProfiler::Resolve(uint32_t frame) {
+    auto& passes = frames[frame];
+    if (!passes.recorded)
+        return false;
+    passes.recorded = false;
+    const uint32_t passCount = passes.names.size();
+    results.assign(passCount, GpuPassResult());
+    frameTime = 0;
+
+    std::vector<uint64_t> timestamps(passCount * 2, 0);
+    if (timestampPool && passCount > 0 && device.getQueryPoolResults(timestampPool, frame * MAX_GPU_PASSES * 2, passCount * 2, timestamps.size() * sizeof(uint64_t),
+        timestamps.data(), sizeof(uint64_t), vk::QueryResultFlagBits::e64) != vk::Result::eSuccess)
+        std::fill(timestamps.begin(), timestamps.end(), 0);
+    for (uint32_t pass = 0; pass < passCount; pass++) {
+        auto& result = results[pass];
+        result.name = passes.names[pass];
+        result.time = ((timestamps[pass * 2 + 1] - timestamps[pass * 2]) & timestampMask) * timestampPeriod / 1000000.0;
+        // Passes without statistics never began their query, reading it would not succeed.
+        std::array<uint64_t, 3> statistics = {};
+        if (passes.statistics[pass] && device.getQueryPoolResults(statisticsPool, frame * MAX_GPU_PASSES + pass, 1, sizeof(statistics), statistics.data(), sizeof(statistics),
+            vk::QueryResultFlagBits::e64) == vk::Result::eSuccess) {
+            result.fragmentInvocations = statistics[0];
+            result.taskInvocations     = statistics[1];
+            result.meshInvocations     = statistics[2];
+        }
+    }
+    if (passCount > 0)
+        frameTime = ((timestamps[passCount * 2 - 1] - timestamps[0]) & timestampMask) * timestampPeriod / 1000000.0;
+    return true;
+}
+
+const std::vector<GpuPassResult>& GpuProfiler::GetResults() {
+    return results;
+}
+
+double GpuProfiler::GetFrameTime() {
+    return frameTime;
+}
+
+bool GpuProfiler::HasTimestamps() {
+    return static_cast<bool>(timestampPool);
+}
+
+vk::QueryPipelineStatisticFlags GpuProfiler::GetStatisticFlags() {
+    return statisticFlags;
+}
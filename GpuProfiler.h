@@ -0,0 +1,65 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <string>
+#include <vector>
+
+// GPU time and shader invocations of one pass in a finished frame.
+struct GpuPassResult {
+	std::string name;
+	double time;
+	// 0 without pipeline statistics, or for passes that do not collect them.
+	uint64_t taskInvocations;
+	uint64_t meshInvocations;
+	uint64_t fragmentInvocations;
+};
+// Passes a frame may time, later ones are ignored.
+constexpr uint32_t MAX_GPU_PASSES = 16;
+
+// Timestamps around each pass of a frame, and pipeline statistics for the passes that ask for them.
+// Every frame in flight has its own queries, read back once the frame finished, so nothing waits on the GPU.
+class GpuProfiler
+{
+public:
+	GpuProfiler();
+	// Statistics need the pipelineStatisticsQuery, inheritedQueries and meshShaderQueries features.
+	GpuProfiler(vk::Device device, vk::PhysicalDevice physicalDevice, uint32_t queueFamilyIndex, uint32_t frameCount, bool pipelineStatistics);
+
+	// Resets the frame's queries, recorded before any pass.
+	void BeginFrame(vk::CommandBuffer& cmd, uint32_t frame);
+	// Passes may not nest. A statistics pass has to begin and end inside the same render pass, or both outside of one.
+	void BeginPass(vk::CommandBuffer& cmd, uint32_t frame, const std::string& name, bool statistics = false);
+	void EndPass(vk::CommandBuffer& cmd, uint32_t frame);
+	// Reads back the frame, its last submit has to be finished. False when it recorded nothing since the last call.
+	bool Resolve(uint32_t frame);
+
+	// Passes of the frame resolved last, in recording order.
+	const std::vector<GpuPassResult>& GetResults();
+	// First pass begin to last pass end of the frame resolved last.
+	double GetFrameTime();
+	bool HasTimestamps();
+	// Flags secondary command buffers executed inside a statistics pass have to inherit, empty without statistics.
+	vk::QueryPipelineStatisticFlags GetStatisticFlags();
+
+private:
+	struct FramePasses {
+		std::vector<std::string> names;
+		std::vector<bool> statistics;
+		// Pass between BeginPass and EndPass, UINT32_MAX when none is or it did not fit.
+		uint32_t openPass = UINT32_MAX;
+		bool recorded = false;
+	};
+
+	vk::Device device;
+	vk::QueryPool timestampPool;
+	vk::QueryPool statisticsPool;
+	vk::QueryPipelineStatisticFlags statisticFlags;
+	// Nanoseconds per tick, and the bits of a timestamp that are valid.
+	double timestampPeriod = 0;
+	uint64_t timestampMask = 0;
+
+	std::vector<FramePasses> frames;
+	std::vector<GpuPassResult> results;
+	double frameTime = 0;
+};
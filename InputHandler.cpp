@@ -5,8 +5,11 @@ InputHandler::InputHandler(SDL_Window* Window, float Sensitivity) {
     window         = Window;
 }
 bool InputHandler::PollEvents(SDL_Event& Event, bool& GrabMouse, float& Pitch, float& Yaw) {
+    oldestEventTime = 0;
     while (SDL_PollEvent(&Event)) {
         ImGui_ImplSDL3_ProcessEvent(&Event);
+        if ((Event.type == SDL_EVENT_MOUSE_MOTION || Event.type == SDL_EVENT_KEY_DOWN || Event.type == SDL_EVENT_KEY_UP) && oldestEventTime == 0)
+            oldestEventTime = Event.common.timestamp;
         switch (Event.type) {
         case SDL_EVENT_MOUSE_MOTION:
             if (GrabMouse) {
@@ -34,6 +37,9 @@ bool InputHandler::PollEvents(SDL_Event& Event, bool& GrabMouse, float& Pitch, f
     }
     return true;
 }
+uint64_t InputHandler::GetOldestEventTime() {
+    return oldestEventTime;
+}
 bool InputHandler::IsPressed(SDL_Scancode key) {
 	auto& held = isHeld[key];
 	if (keyboardStates[key]) {
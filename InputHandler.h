@@ -11,6 +11,8 @@ class InputHandler
 public:
 	InputHandler(SDL_Window* Window, float Sensitivity = 0.1f);
 	bool PollEvents(SDL_Event& Event, bool& GrabMouse, float& Pitch, float& Yaw);
+	// SDL timestamp in nanoseconds of the oldest mouse or key event the last PollEvents handled, 0 if there was none.
+	uint64_t GetOldestEventTime();
 
 	// Call after PollEvents.
 	bool IsPressed(SDL_Scancode key);
@@ -19,6 +21,7 @@ private:
 	SDL_Window* window;
 	const bool* keyboardStates;
 	std::map<SDL_Scancode, bool> isHeld;
+	uint64_t oldestEventTime = 0;
 
 	float sensitivity = 0.1f;
 };
\ No newline at end of file
@@ -9,8 +9,10 @@ Instance::Instance() {
 Instance::Instance(SDL_Window* window, std::atomic<bool>* ready) {
 
     // Get WSI (Window System Integration) extensions from SDL.
-    unsigned extensionCount;
-    auto instanceExtensions = SDL_Vulkan_GetInstanceExtensions(&extensionCount);
+    unsigned extensionCount = 0;
+    const char* const* instanceExtensions = nullptr;
+    if (window)
+        instanceExtensions = SDL_Vulkan_GetInstanceExtensions(&extensionCount);
 
     // Use validation layers if this is a debug build.
     std::vector<const char*> layers;
@@ -41,8 +43,8 @@ Instance::Instance(SDL_Window* window, std::atomic<bool>* ready) {
     }
 
     // Create a Vulkan surface for rendering.
-    VkSurfaceKHR cSurface;
-    if (!SDL_Vulkan_CreateSurface(window, static_cast<VkInstance>(instance), nullptr, &cSurface)) {
+    VkSurfaceKHR cSurface = VK_NULL_HANDLE;
+    if (window && !SDL_Vulkan_CreateSurface(window, static_cast<VkInstance>(instance), nullptr, &cSurface)) {
         std::cout << "Could not create a Vulkan surface." << std::endl;
     }
     surface = vk::SurfaceKHR(cSurface);
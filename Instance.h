@@ -8,6 +8,7 @@ class Instance
 {
 public:
 	Instance();
+	// Without a window the instance is headless, it enables no WSI extensions and has no surface.
 	Instance(SDL_Window* window, std::atomic<bool>* ready);
 
 	vk::Instance instance;
@@ -0,0 +1,183 @@
+#include "JobSystem.h"
+#include "Profiler.h"
+
+#include <algorithm>
+
+// Slot of the current thread, threads that are not workers never run jobs.
+thread_local uint32_t currentWorker = UINT32_MAX;
+// Jobs run while waiting inside another job, only the outermost one counts as busy time.
+thread_local uint32_t executeDepth = 0;
+
+JobSystem::JobSystem() {
+
+}
+
+JobSystem::~JobSystem() {
+    Stop();
+    for (auto& t : threads)
+        t.join();
+}
+
+void JobSystem::Start(uint32_t workerCount) {
+    workerCount = std::max(1u, workerCount);
+    for (uint32_t i = 0; i < workerCount; i++)
+        workers.emplace_back(std::make_unique<Worker>());
+    sampledBusy.resize(workerCount, 0);
+    sampleTime = std::chrono::steady_clock::now();
+    for (uint32_t i = 1; i < workerCount; i++)
+        threads.emplace_back(&JobSystem::WorkerLoop, this, i);
+}
+
+void JobSystem::Work() {
+    WorkerLoop(0);
+}
+
+void JobSystem::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stop = true;
+    }
+    wake.notify_all();
+}
+
+JobHandle JobSystem::Submit(std::function<void(uint32_t)> func, std::span<const JobHandle> dependencies) {
+    auto job  = std::make_shared<Job>();
+    job->func = std::move(func);
+    for (const auto& dependency : dependencies) {
+        std::lock_guard<std::mutex> lock(dependency->mutex);
+        if (dependency->finished)
+            continue;
+        job->pendingDependencies++;
+        dependency->continuations.emplace_back(job);
+    }
+    if (--job->pendingDependencies == 0)
+        Push(job);
+    return job;
+}
+
+void JobSystem::Wait(const JobHandle& job) {
+    const uint32_t worker = currentWorker;
+    while (!job->finished) {
+        if (worker != UINT32_MAX) {
+            if (auto other = Pop(worker)) {
+                Execute(other, worker);
+                continue;
+            }
+        }
+        // Stop does not end the wait, workers run every queued job before they return.
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [&]() { return job->finished || (worker != UINT32_MAX && queuedJobs > 0); });
+    }
+}
+
+void JobSystem::Wait(std::span<const JobHandle> jobs) {
+    for (const auto& job : jobs)
+        Wait(job);
+}
+
+void JobSystem::Run(uint32_t jobCount, const std::function<void(uint32_t, uint32_t)>& func, uint32_t maxWorkers) {
+    // One runner per worker pulls jobs until none are left, whichever slot runs it.
+    std::atomic<uint32_t> nextJob = 0;
+    const uint32_t runnerCount = std::min({ maxWorkers, GetWorkerCount(), jobCount });
+    std::vector<JobHandle> runners;
+    for (uint32_t i = 0; i < runnerCount; i++)
+        runners.emplace_back(Submit([&](uint32_t worker) {
+            for (uint32_t job = nextJob++; job < jobCount; job = nextJob++)
+                func(job, worker);
+        }));
+    Wait(runners);
+}
+
+uint32_t JobSystem::GetWorkerCount() {
+    return std::max<uint32_t>(workers.size(), 1);
+}
+
+std::vector<float> JobSystem::GetUtilization() {
+    const auto now     = std::chrono::steady_clock::now();
+    const double total = std::chrono::duration<double, std::micro>(now - sampleTime).count();
+    sampleTime = now;
+    std::vector<float> utilization(workers.size());
+    for (size_t i = 0; i < workers.size(); i++) {
+        const uint64_t busy = workers[i]->busyMicroseconds;
+        utilization[i] = total > 0 ? std::min(1.0, (busy - sampledBusy[i]) / total) : 0;
+        sampledBusy[i] = busy;
+    }
+    return utilization;
+}
+
+void JobSystem::WorkerLoop(uint32_t worker) {
+    currentWorker = worker;
+    Profiler::SetThreadName("Worker " + std::to_string(worker));
+    while (true) {
+        if (auto job = Pop(worker)) {
+            Execute(job, worker);
+            continue;
+        }
+        // Queued jobs still run after Stop, a job a waiter depends on must not be dropped.
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [&]() { return stop || queuedJobs > 0; });
+        if (stop && queuedJobs == 0)
+            break;
+    }
+    currentWorker = UINT32_MAX;
+}
+
+void JobSystem::Push(JobHandle job) {
+    // Workers queue follow-up work for themselves, other threads spread it out.
+    const uint32_t worker = currentWorker != UINT32_MAX ? currentWorker : nextQueue++ % workers.size();
+    // Counted under the queue's lock, so Pop never takes a job before it was counted.
+    {
+        std::lock_guard<std::mutex> lock(workers[worker]->mutex);
+        workers[worker]->jobs.emplace_back(std::move(job));
+        queuedJobs++;
+    }
+    // Sleepers check the count under the sleep mutex, taking it once keeps them from missing the wake.
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+    }
+    wake.notify_all();
+}
+
+JobHandle JobSystem::Pop(uint32_t worker) {
+    for (uint32_t i = 0; i < workers.size(); i++) {
+        auto& victim = *workers[(worker + i) % workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (victim.jobs.empty())
+            continue;
+        JobHandle job;
+        if (i == 0) {
+            job = std::move(victim.jobs.back());
+            victim.jobs.pop_back();
+        }
+        else {
+            job = std::move(victim.jobs.front());
+            victim.jobs.pop_front();
+        }
+        queuedJobs--;
+        return job;
+    }
+    return nullptr;
+}
+
+void JobSystem::Execute(const JobHandle& job, uint32_t worker) {
+    const auto start = std::chrono::steady_clock::now();
+    executeDepth++;
+    job->func(worker);
+    if (--executeDepth == 0)
+        workers[worker]->busyMicroseconds += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<JobHandle> continuations;
+    {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        job->finished = true;
+        continuations.swap(job->continuations);
+    }
+    for (auto& continuation : continuations)
+        if (--continuation->pendingDependencies == 0)
+            Push(std::move(continuation));
+    // Waiters check finished under the sleep mutex, taking it once keeps them from missing the wake.
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+    }
+    wake.notify_all();
+}
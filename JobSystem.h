@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+// Submitted job, only the job system touches its state.
+struct Job {
+	std::function<void(uint32_t)> func;
+	// Unfinished dependencies, plus one while the job is still being submitted.
+	std::atomic<uint32_t> pendingDependencies = 1;
+	std::mutex mutex;
+	std::vector<std::shared_ptr<Job>> continuations;
+	std::atomic<bool> finished = false;
+};
+using JobHandle = std::shared_ptr<Job>;
+
+// Work-stealing job system owned by the application.
+// Every worker slot keeps its own queue, runs its newest job first and steals the oldest job of another slot when it runs dry.
+// Slot 0 belongs to the thread that calls Work, the other slots get their own threads.
+class JobSystem
+{
+public:
+	JobSystem();
+	~JobSystem();
+
+	// Spawns threads for every slot but the first.
+	void Start(uint32_t workerCount);
+	// Turns the calling thread into worker 0 until Stop is called.
+	void Work();
+	// Lets all workers return once every queued job ran.
+	void Stop();
+
+	// func(worker) runs once every dependency finished. A job that calls Wait can have other jobs run nested on its worker, so per worker state must not assume one job at a time.
+	JobHandle Submit(std::function<void(uint32_t)> func, std::span<const JobHandle> dependencies = {});
+	// Returns once the job finished, workers keep running other jobs while they wait, any other thread blocks.
+	void Wait(const JobHandle& job);
+	void Wait(std::span<const JobHandle> jobs);
+	// Runs func(job, worker) for every job below jobCount on at most maxWorkers workers and returns once all finished.
+	void Run(uint32_t jobCount, const std::function<void(uint32_t, uint32_t)>& func, uint32_t maxWorkers = UINT32_MAX);
+
+	uint32_t GetWorkerCount();
+	// Busy fraction of every worker since the previous call.
+	std::vector<float> GetUtilization();
+
+private:
+	struct Worker {
+		std::mutex mutex;
+		std::deque<JobHandle> jobs;
+		std::atomic<uint64_t> busyMicroseconds = 0;
+	};
+	void WorkerLoop(uint32_t worker);
+	void Push(JobHandle job);
+	JobHandle Pop(uint32_t worker);
+	void Execute(const JobHandle& job, uint32_t worker);
+
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::vector<std::thread> threads;
+	std::atomic<uint32_t> queuedJobs = 0;
+	std::atomic<uint32_t> nextQueue = 0;
+	std::atomic<bool> stop = false;
+	// Sleeping workers and waiting threads, woken on new jobs, finished jobs and Stop.
+	std::mutex sleepMutex;
+	std::condition_variable wake;
+
+	std::vector<uint64_t> sampledBusy;
+	std::chrono::steady_clock::time_point sampleTime;
+};
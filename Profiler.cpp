@@ -0,0 +1,87 @@
+#include "Profiler.h"
+#include "FrameStats.h"
+
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Zones a thread keeps before it overwrites its oldest ones.
+constexpr size_t ZONES_PER_THREAD = 1 << 15;
+
+struct Zone {
+    const char* name;
+    int64_t begin;
+    int64_t end;
+};
+// Owned by one thread, the mutex is only ever contended while a trace is written.
+struct ThreadZones {
+    std::mutex mutex;
+    std::vector<Zone> zones;
+    uint64_t written = 0;
+    uint32_t id;
+    std::string name;
+};
+
+std::atomic<bool> Profiler::enabled = false;
+const std::chrono::steady_clock::time_point Profiler::epoch = std::chrono::steady_clock::now();
+
+// Rings of every thread that recorded or was named, kept after the thread exits so its zones still end up in the trace.
+std::mutex threadsMutex;
+std::vector<std::unique_ptr<ThreadZones>> threads;
+thread_local ThreadZones* currentThread = nullptr;
+
+ThreadZones& GetThreadZones() {
+    if (currentThread)
+        return *currentThread;
+    std::lock_guard<std::mutex> lock(threadsMutex);
+    threads.emplace_back(std::make_unique<ThreadZones>());
+    currentThread       = threads.back().get();
+    currentThread->id   = threads.size();
+    currentThread->name = "Thread " + std::to_string(currentThread->id);
+    return *currentThread;
+}
+
+void Profiler::SetEnabled(bool enabled) {
+    Profiler::enabled = enabled;
+}
+
+void Profiler::SetThreadName(const std::string& name) {
+    auto& thread = GetThreadZones();
+    std::lock_guard<std::mutex> lock(thread.mutex);
+    thread.name = name;
+}
+
+void Profiler::Record(const char* name, int64_t begin, int64_t end) {
+    auto& thread = GetThreadZones();
+    std::lock_guard<std::mutex> lock(thread.mutex);
+    // Zones are only recorded while enabled, so threads that never record while profiling never get a ring.
+    if (thread.zones.empty())
+        thread.zones.resize(ZONES_PER_THREAD);
+    thread.zones[thread.written++ % ZONES_PER_THREAD] = Zone{ name, begin, end };
+}
+
+bool Profiler::WriteChromeTrace(const std::filesystem::path& path) {
+    std::ofstream file(path);
+    if (!file)
+        return false;
+    // Complete events in microseconds, plus one metadata event naming each thread.
+    file << std::fixed << std::setprecision(3);
+    file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    bool first = true;
+    std::lock_guard<std::mutex> threadsLock(threadsMutex);
+    for (const auto& thread : threads) {
+        std::lock_guard<std::mutex> lock(thread->mutex);
+        file << (first ? "" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << thread->id << ", \"args\": {\"name\": \"" << EscapeJson(thread->name) << "\"}}";
+        first = false;
+        const uint64_t oldest = thread->written > ZONES_PER_THREAD ? thread->written - ZONES_PER_THREAD : 0;
+        for (uint64_t i = oldest; i < thread->written; i++) {
+            const auto& zone = thread->zones[i % ZONES_PER_THREAD];
+            file << ",\n{\"name\": \"" << EscapeJson(zone.name) << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << thread->id
+                << ", \"ts\": " << zone.begin / 1000.0 << ", \"dur\": " << (zone.end - zone.begin) / 1000.0 << "}";
+        }
+    }
+    file << "\n]}\n";
+    return file.good();
+}
@@ -3,45 +3,171 @@
 
 #include "Renderer.h"
 
-Renderer::Renderer(SDL_Window* window, std::atomic<bool>* ready) {
+Renderer::Renderer(SDL_Window* window, std::atomic<bool>* ready, JobSystem& jobSystem, RendererSettings settings) : settings(settings), jobSystem(jobSystem) {
     InitMainObjects(window, ready);
     CreateFencesAndSemaphores();
 
     CreateSamplers_Init();
+    CreateDescSets_Init();
     CreateDebugTextures();
 
     LoadModels_Init();
+    LoadTextures_Init();
     SpawnLights_Init();
-    OptimizeMesh();
+    if (sceneCacheHit)
+        LoadSceneCache_Init();
+    else
+        OptimizeMesh();
     UploadAll_Init();
+    ReleaseSceneCopies_Init();
+    ReportSceneMemory();
 
-    CreateDescSets_Init();
+    CreateFeedbackBuffers_Init();
+    CreateFrameConstants_Init();
+    CreateGpuProfiler_Init();
     CreatePipeline();
 
     // Setup UI.
-    InitImGui(window);
+    if (!settings.headless)
+        InitImGui(window);
+    if (settings.submitThread)
+        submitThread = std::thread(&Renderer::SubmitLoop, this);
+}
+Renderer::~Renderer() {
+    if (!submitThread.joinable())
+        return;
+    WaitSubmitIdle();
+    stopSubmitThread = true;
+    pushedSubmits++;
+    pushedSubmits.notify_one();
+    submitThread.join();
 }
 
 void Renderer::Draw() {
+    PROFILE_ZONE("Frame");
+    BeginFrame();
     command.SetCurrentFrame(currentFrame);
 
     double frameTime = frameTimer.GetMilliseconds();
     frameTimer.Reset();
-    uint32_t imageIndex;
-    if (!AquireImageIndex(imageIndex)) return;
+    if (!settings.lowLatency)
+        LatchInput();
 
-    ImGui_Draw(frameTime);
-    BeginRendering(imageIndex);
-    PushConstant_Draw();
-    cmdBuffers[currentFrame].bindShadersEXT(meshStages, shaders, dldid);
-    // Launch one invocation per meshlet,
-    // then inside each invocation, emit one mesh shader each primitive.
-    // Draw meshes.
-    cmdBuffers[currentFrame].drawMeshTasksEXT(meshlets.size(), 1, 1, dldid);
-    ImGui::Render();
-    ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), static_cast<VkCommandBuffer>(cmdBuffers[currentFrame]));
+    ReleaseRetired_Draw();
+    if (!settings.headless)
+        ImGui_Draw(frameTime);
+    if (runRecordBenchmark)
+        BenchmarkRecording();
+
+    command.ResetThreadPools(currentFrame);
+    auto beginInfo = vk::CommandBufferBeginInfo()
+        .setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+    frames[currentFrame].cmdBuffer.begin(beginInfo);
+    gpuProfiler.BeginFrame(frames[currentFrame].cmdBuffer, currentFrame);
+    frames[currentFrame].reportFrame = frameNumber;
+    // Texture uploads have to be recorded before rendering starts.
+    gpuProfiler.BeginPass(frames[currentFrame].cmdBuffer, currentFrame, "Uploads");
+    StreamTextures_Draw();
+    gpuProfiler.EndPass(frames[currentFrame].cmdBuffer, currentFrame);
+    // Commands only hold the address of the constants, so they can be written after recording.
+    frameConstantsAddress = frameConstantRing.bufferAddress + currentFrame * frameConstantStride;
+    if (!settings.lowLatency)
+        FrameConstants_Draw();
+    // Secondaries only inherit attachment formats, so the scene is recorded before an image is acquired.
+    RecordScene_Draw();
+    // Acquired as late as possible, it waits for the swapchain while the submission thread presents.
+    uint32_t imageIndex = UINT32_MAX;
+    if (AquireImageIndex(imageIndex)) {
+        // Clearing the attachments is part of the scene pass, its statistics are inherited by the secondaries.
+        gpuProfiler.BeginPass(frames[currentFrame].cmdBuffer, currentFrame, "Scene", true);
+        BeginRendering(imageIndex);
+        if (!sceneCommands.empty())
+            frames[currentFrame].cmdBuffer.executeCommands(sceneCommands);
+        frames[currentFrame].cmdBuffer.endRendering();
+        gpuProfiler.EndPass(frames[currentFrame].cmdBuffer, currentFrame);
+        if (!settings.headless) {
+            gpuProfiler.BeginPass(frames[currentFrame].cmdBuffer, currentFrame, "ImGui");
+            ImGuiPass_Draw(imageIndex);
+            gpuProfiler.EndPass(frames[currentFrame].cmdBuffer, currentFrame);
+        }
+    }
+    else {
+        // Uploads recorded this frame still have to be submitted.
+        imageIndex = UINT32_MAX;
+        if (!settings.headless)
+            ImGui::EndFrame();
+    }
+    // Nothing blocks between reading the input and submitting anymore.
+    if (settings.lowLatency) {
+        LatchInput();
+        FrameConstants_Draw();
+    }
 
     SubmitAndPresent(imageIndex);
+    frameNumber++;
+}
+
+void Renderer::SetInputLatch(std::function<uint64_t()> latch) {
+    inputLatch = std::move(latch);
+}
+std::string Renderer::GetDeviceName() {
+    return std::string(device.physicalDevice.getProperties().deviceName.data());
+}
+vk::Extent2D Renderer::GetRenderExtent() {
+    return swapchain.renderExtend;
+}
+uint64_t Renderer::GetFrameNumber() {
+    return frameNumber;
+}
+double Renderer::GetWaitTime() {
+    return frameLimiter.GetWaitTime() + fenceWaitTime;
+}
+std::vector<FrameReport> Renderer::TakeFrameReports() {
+    std::vector<FrameReport> reports;
+    reports.swap(frameReports);
+    return reports;
+}
+void Renderer::Flush() {
+    WaitSubmitIdle();
+    WaitTimeline(submittedTimelineValue);
+    // The current frame is the oldest one in flight.
+    for (uint32_t i = 0; i < frames.size(); i++)
+        CollectFrameReport((currentFrame + i) % frames.size());
+}
+void Renderer::BeginFrame() {
+    PROFILE_ZONE("Begin frame");
+    // Limited before the frame slot is waited on, so input is still read after the limiter.
+    {
+        PROFILE_ZONE("Frame limiter");
+        frameLimiter.Wait(settings.frameRateLimit);
+    }
+    Timer fenceTimer = Timer();
+    if (settings.lowLatency) {
+        // The previous frame has to be on screen, or at least rendered, before this one reads input.
+        if (device.supportsPresentWait && presentId > 0) {
+            WaitSubmitIdle();
+            std::lock_guard<std::mutex> lock(swapchainMutex);
+            try {
+                (void)device.device.waitForPresentKHR(swapchain.swapchain, presentId, PRESENT_WAIT_TIMEOUT, dldid);
+            }
+            catch (const vk::SystemError&) {
+                // An out of date swapchain is replaced by the next acquire or present.
+            }
+        }
+        WaitTimeline(submittedTimelineValue);
+    }
+    else {
+        // The frame's command buffer is reset by begin, only its last submit has to be finished.
+        // Its value may still sit in the submission queue, waiting on the timeline covers that as well.
+        WaitTimeline(frames[currentFrame].timelineValue);
+    }
+    fenceWaitTime = fenceTimer.GetMilliseconds();
+    CollectFrameReport(currentFrame);
+}
+void Renderer::LatchInput() {
+    PROFILE_ZONE("Latch input");
+    inputEventTime = inputLatch ? inputLatch() : 0;
+    inputTime      = std::chrono::steady_clock::now();
 }
 
 // Camera related functions.
@@ -54,6 +180,11 @@ void Renderer::Teleport(glm::vec3 pos, glm::vec3 direction) {
     yaw = -90;
     pitch = 0;
 }
+void Renderer::SetCamera(glm::vec3 pos, float yaw, float pitch) {
+    position    = pos;
+    this->yaw   = yaw;
+    this->pitch = pitch;
+}
 void Renderer::BuildGlobalTransform() {
     direction.x = cos(glm::radians(yaw)) * cos(glm::radians(pitch));
     direction.y = sin(glm::radians(pitch));
@@ -68,26 +199,110 @@ void Renderer::BuildGlobalTransform() {
 }
 
 bool Renderer::AquireImageIndex(uint32_t& index) {
-    const auto imageNext   = device.device.acquireNextImageKHR(swapchain.Get(), UINT64_MAX, imageAquiredSemaphores[currentFrame], nullptr);
-    const auto imageResult = imageNext.result;
-    index = imageNext.value;
-    if (imageResult == vk::Result::eSuboptimalKHR || imageResult == vk::Result::eErrorOutOfDateKHR) {
-        swapchain.Recreate(instance.pWindow, doVsync);
-        requestNewSwapchain = false;
+    PROFILE_ZONE("Acquire image");
+    // Offscreen targets are simply taken in turn.
+    if (swapchain.IsHeadless()) {
+        index = frameNumber % swapchain.images.size();
+        return true;
+    }
+    // Out of date means nothing was acquired and the semaphore stays unsignalled, so the frame is skipped.
+    // Suboptimal still acquired an image, it is rendered and the swapchain replaced after presenting it.
+    try {
+        while (true) {
+            // The image may only come back once a pending frame is presented, so the swapchain is never held while that is outstanding.
+            const uint32_t pending = pendingSubmits;
+            vk::ResultValue<uint32_t> imageNext(vk::Result::eNotReady, 0);
+            {
+                std::lock_guard<std::mutex> lock(swapchainMutex);
+                imageNext = device.device.acquireNextImageKHR(swapchain.Get(), pending > 0 ? 0 : ACQUIRE_TIMEOUT, frames[currentFrame].imageAquiredSemaphore, nullptr);
+            }
+            if (imageNext.result == vk::Result::eTimeout || imageNext.result == vk::Result::eNotReady) {
+                // Sleeps until the submission thread presented another frame.
+                if (pending > 0)
+                    pendingSubmits.wait(pending);
+                continue;
+            }
+            index = imageNext.value;
+            if (imageNext.result == vk::Result::eSuboptimalKHR)
+                requestNewSwapchain = true;
+            break;
+        }
+    }
+    catch (const vk::OutOfDateKHRError&) {
+        RecreateSwapchain();
         return false;
     }
     return true;
 }
-void Renderer::BeginRendering(const uint32_t imageIndex) {
-    auto beginInfo = vk::CommandBufferBeginInfo()
-        .setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
-    cmdBuffers[currentFrame].begin(beginInfo);
+void Renderer::RecreateSwapchain() {
+    PROFILE_ZONE("Recreate swapchain");
+    // Nothing may still be presented to the swapchain that is retired.
+    WaitSubmitIdle();
+    requestNewSwapchain = false;
+    presentId = 0;
+    int w, h;
+    SDL_GetWindowSizeInPixels(instance.pWindow, &w, &h);
+    if (w == 0 || h == 0)
+        return;
 
+    // Presentation has no completion signal, the old swapchain is kept until a frame presented to the new one completed.
+    const vk::Extent2D oldExtend = swapchain.renderExtend;
+    retiredSwapchains.emplace_back(swapchain.Recreate(instance.pWindow, settings.presentMode));
+    for (size_t i = renderFinishedSemaphores.size(); i < swapchain.images.size(); i++)
+        renderFinishedSemaphores.emplace_back(device.device.createSemaphore(vk::SemaphoreCreateInfo()));
+
+    // Depth of each frame is only read by that frame's last submit.
+    if (swapchain.renderExtend != oldExtend)
+        for (auto& frame : frames) {
+            deletionQueue.PushImage(frame.timelineValue, frame.depthImage.image, frame.depthImage.view, frame.depthImage.alloc);
+            frame.depthImage = CreateDepthImage();
+        }
+}
+void Renderer::BeginRendering(const uint32_t imageIndex) {
     command.TransitionImage(swapchain.images[imageIndex], swapchain.subresourceRange, vk::ImageLayout::eUndefined, vk::ImageLayout::eColorAttachmentOptimal, vk::AccessFlagBits2::eNone, vk::AccessFlagBits2::eColorAttachmentWrite);
-    command.TransitionImage(depthImages[imageIndex].image, depthSubresourceRange, vk::ImageLayout::eUndefined, vk::ImageLayout::eDepthStencilAttachmentOptimal, vk::AccessFlagBits2::eNone,
+    command.TransitionImage(frames[currentFrame].depthImage.image, depthSubresourceRange, vk::ImageLayout::eUndefined, vk::ImageLayout::eDepthStencilAttachmentOptimal, vk::AccessFlagBits2::eNone,
         vk::AccessFlagBits2::eDepthStencilAttachmentRead | vk::AccessFlagBits2::eDepthStencilAttachmentWrite);
 
-    command.SetDynamicStates(dldid);
+    auto colorAttachment = vk::RenderingAttachmentInfo()
+        .setLoadOp(vk::AttachmentLoadOp::eClear)
+        .setStoreOp(vk::AttachmentStoreOp::eStore)
+        .setClearValue(vk::ClearValue({ 0.1f, 0.1f, 0.3f, 1.0f }))
+        .setImageLayout(vk::ImageLayout::eColorAttachmentOptimal)
+        .setImageView(swapchain.imageViews[imageIndex])
+        .setResolveMode(vk::ResolveModeFlagBits::eNone);
+
+    auto depthAttachment = vk::RenderingAttachmentInfo()
+        .setLoadOp(vk::AttachmentLoadOp::eClear)
+        .setStoreOp(vk::AttachmentStoreOp::eDontCare)
+        .setClearValue(vk::ClearDepthStencilValue(1.0f, 0))
+        .setImageLayout(vk::ImageLayout::eDepthStencilAttachmentOptimal)
+        .setImageView(frames[currentFrame].depthImage.view)
+        .setResolveMode(vk::ResolveModeFlagBits::eNone)
+        .setResolveImageLayout(vk::ImageLayout::eUndefined);
+
+    auto renderArea = vk::Rect2D()
+        .setExtent(swapchain.renderExtend);
+
+    // Everything inside the scene pass comes from secondary command buffers.
+    vk::RenderingInfo renderInfo(vk::RenderingFlagBits::eContentsSecondaryCommandBuffers, renderArea, 1, 0, colorAttachment, &depthAttachment);
+    frames[currentFrame].cmdBuffer.beginRendering(renderInfo);
+}
+vk::CommandBuffer Renderer::BeginSecondary(uint32_t thread) {
+    auto cmd = command.GetSecondary(currentFrame, thread);
+    auto renderingInheritance = vk::CommandBufferInheritanceRenderingInfo()
+        .setColorAttachmentFormats(swapchain.renderFormat)
+        .setDepthAttachmentFormat(depthAttachmentFormat)
+        .setRasterizationSamples(vk::SampleCountFlagBits::e1);
+    auto inheritance = vk::CommandBufferInheritanceInfo()
+        .setPipelineStatistics(gpuProfiler.GetStatisticFlags())
+        .setPNext(&renderingInheritance);
+    auto beginInfo = vk::CommandBufferBeginInfo()
+        .setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit | vk::CommandBufferUsageFlagBits::eRenderPassContinue)
+        .setPInheritanceInfo(&inheritance);
+    cmd.begin(beginInfo);
+
+    // Secondary command buffers inherit no state, each one sets up the whole draw.
+    command.SetDynamicStates(cmd, dldid);
 
     auto viewport = vk::Viewport()
         .setMinDepth(0.0f)
@@ -96,100 +311,268 @@ void Renderer::BeginRendering(const uint32_t imageIndex) {
         .setWidth(swapchain.renderExtend.width)
         .setX(0)
         .setY(0);
-    cmdBuffers[currentFrame].setViewportWithCount(viewport);
+    cmd.setViewportWithCount(viewport);
 
     auto scissor = vk::Rect2D()
         .setExtent(swapchain.renderExtend)
         .setOffset({ 0 ,0 });
-    cmdBuffers[currentFrame].setScissorWithCount(scissor);
+    cmd.setScissorWithCount(scissor);
+
+    cmd.setDepthTestEnable(vk::True);
+    cmd.setDepthWriteEnable(vk::True);
+    cmd.setDepthCompareOp(vk::CompareOp::eLessOrEqual);
+
+    cmd.bindShadersEXT(meshStages, shaders, dldid);
+    cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, frames[currentFrame].imageDescSet, nullptr);
+    return cmd;
+}
+void Renderer::RecordMeshletChunk(vk::CommandBuffer& cmd, uint32_t firstMeshlet, uint32_t meshletCount) {
+    PushConstantData pushConstant{ frameConstantsAddress, firstMeshlet, 0 };
+    cmd.pushConstants(pipelineLayout, vk::ShaderStageFlagBits::eTaskEXT | vk::ShaderStageFlagBits::eMeshEXT | vk::ShaderStageFlagBits::eFragment, 0, sizeof(PushConstantData), &pushConstant);
+    // Launch one invocation per meshlet,
+    // then inside each invocation, emit one mesh shader each primitive.
+    cmd.drawMeshTasksEXT(meshletCount, 1, 1, dldid);
+}
+void Renderer::RecordScene_Draw() {
+    PROFILE_ZONE("Record scene");
+    const uint32_t chunkCount = (meshletCount + chunkMeshlets - 1) / chunkMeshlets;
+    sceneCommands.assign(chunkCount, nullptr);
+    Timer timer = Timer();
+    jobSystem.Run(chunkCount, [&](uint32_t chunk, uint32_t thread) {
+        PROFILE_ZONE("Record chunk");
+        auto cmd = BeginSecondary(thread);
+        const uint32_t first = chunk * chunkMeshlets;
+        RecordMeshletChunk(cmd, first, std::min(chunkMeshlets, meshletCount - first));
+        cmd.end();
+        sceneCommands[chunk] = cmd;
+    });
+    recordTime = timer.GetMilliseconds();
+}
+void Renderer::ImGuiPass_Draw(const uint32_t imageIndex) {
+    PROFILE_ZONE("Record ImGui");
+    // ImGui records inline, so it gets its own pass on top of the scene.
+    command.TransitionImage(swapchain.images[imageIndex], swapchain.subresourceRange, vk::ImageLayout::eColorAttachmentOptimal, vk::ImageLayout::eColorAttachmentOptimal,
+        vk::AccessFlagBits2::eColorAttachmentWrite, vk::AccessFlagBits2::eColorAttachmentRead | vk::AccessFlagBits2::eColorAttachmentWrite);
 
     auto colorAttachment = vk::RenderingAttachmentInfo()
-        .setLoadOp(vk::AttachmentLoadOp::eClear)
+        .setLoadOp(vk::AttachmentLoadOp::eLoad)
         .setStoreOp(vk::AttachmentStoreOp::eStore)
-        .setClearValue(vk::ClearValue({ 0.1f, 0.1f, 0.3f, 1.0f }))
         .setImageLayout(vk::ImageLayout::eColorAttachmentOptimal)
         .setImageView(swapchain.imageViews[imageIndex])
         .setResolveMode(vk::ResolveModeFlagBits::eNone);
 
-    cmdBuffers[currentFrame].setDepthTestEnable(vk::True);
-    cmdBuffers[currentFrame].setDepthWriteEnable(vk::True);
-    cmdBuffers[currentFrame].setDepthCompareOp(vk::CompareOp::eLessOrEqual);
-
-    auto depthAttachment = vk::RenderingAttachmentInfo()
-        .setLoadOp(vk::AttachmentLoadOp::eClear)
-        .setStoreOp(vk::AttachmentStoreOp::eDontCare)
-        .setClearValue(vk::ClearDepthStencilValue(1.0f, 0))
-        .setImageLayout(vk::ImageLayout::eDepthStencilAttachmentOptimal)
-        .setImageView(depthImages[imageIndex].view)
-        .setResolveMode(vk::ResolveModeFlagBits::eNone)
-        .setResolveImageLayout(vk::ImageLayout::eUndefined);
-
     auto renderArea = vk::Rect2D()
         .setExtent(swapchain.renderExtend);
 
-    vk::RenderingInfo renderInfo(vk::RenderingFlags(), renderArea, 1, 0, colorAttachment, &depthAttachment);
-    cmdBuffers[currentFrame].beginRendering(renderInfo);
+    vk::RenderingInfo renderInfo(vk::RenderingFlags(), renderArea, 1, 0, colorAttachment);
+    frames[currentFrame].cmdBuffer.beginRendering(renderInfo);
+    ImGui::Render();
+    ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), static_cast<VkCommandBuffer>(frames[currentFrame].cmdBuffer));
+    frames[currentFrame].cmdBuffer.endRendering();
 }
-void Renderer::SubmitImmediate(const std::function<void()>& func) {
-    device.device.resetFences(immediateFence);
-
+void Renderer::BenchmarkRecording() {
+    PROFILE_ZONE("Benchmark recording");
+    runRecordBenchmark = false;
+    recordBenchmarkResults.clear();
+    const uint32_t chunkCount = (meshletCount + chunkMeshlets - 1) / chunkMeshlets;
+    const uint32_t jobCount   = chunkCount * RECORD_BENCHMARK_PASSES;
+    std::cout << "Recording " << RECORD_BENCHMARK_PASSES << " passes of " << chunkCount << " secondary command buffers:\n";
+    // Only recorded, never submitted, the pools are reset again before the frame records.
+    for (uint32_t threads = 1; ; threads = std::min(threads * 2, jobSystem.GetWorkerCount())) {
+        command.ResetThreadPools(currentFrame);
+        Timer timer = Timer();
+        jobSystem.Run(jobCount, [&](uint32_t job, uint32_t thread) {
+            auto cmd = BeginSecondary(thread);
+            const uint32_t first = job % chunkCount * chunkMeshlets;
+            RecordMeshletChunk(cmd, first, std::min(chunkMeshlets, meshletCount - first));
+            cmd.end();
+        }, threads);
+        const double ms = timer.GetMilliseconds();
+        recordBenchmarkResults.emplace_back(threads, ms);
+        std::cout << "  " << threads << " threads: " << ms << " ms\n";
+        if (threads == jobSystem.GetWorkerCount())
+            break;
+    }
+}
+uint64_t Renderer::SubmitImmediate(const std::function<void(vk::CommandBuffer&)>& func) {
+    PROFILE_ZONE("Submit immediate");
+    // Own command buffer, so several uploads can be pending at once and no frame's buffer is touched.
+    auto allocInfo = vk::CommandBufferAllocateInfo()
+        .setCommandBufferCount(1)
+        .setCommandPool(command.cmdPool)
+        .setLevel(vk::CommandBufferLevel::ePrimary);
+    vk::CommandBuffer cmd = device.device.allocateCommandBuffers(allocInfo)[0];
     vk::CommandBufferBeginInfo beginInfo = vk::CommandBufferBeginInfo()
         .setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
-    cmdBuffers[0].begin(beginInfo);
-    cmdBuffers[1].begin(beginInfo);
-
-    func();
-
-    cmdBuffers[0].end();
-    cmdBuffers[1].end();
-
-    vk::SubmitInfo submitInfo = vk::SubmitInfo()
-        .setCommandBuffers(cmdBuffers);
-    graphicsQueue.submit(submitInfo, immediateFence);
-    device.device.waitForFences(immediateFence, false, UINT64_MAX);
+    cmd.begin(beginInfo);
+
+    func(cmd);
+
+    cmd.end();
+
+    // Timeline values have to be signalled in order, so frames handed to the submission thread go first.
+    WaitSubmitIdle();
+    auto cmdBufferInfo = vk::CommandBufferSubmitInfo()
+        .setCommandBuffer(cmd);
+    auto timelineSignal = vk::SemaphoreSubmitInfo()
+        .setSemaphore(graphicsTimeline)
+        .setValue(++submittedTimelineValue)
+        .setStageMask(vk::PipelineStageFlagBits2::eAllCommands);
+    auto submitInfo = vk::SubmitInfo2()
+        .setCommandBufferInfos(cmdBufferInfo)
+        .setSignalSemaphoreInfos(timelineSignal);
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        graphicsQueue.submit2(submitInfo);
+    }
+    deletionQueue.PushCallback(submittedTimelineValue, [this, cmd]() { device.device.freeCommandBuffers(command.cmdPool, cmd); });
+    return submittedTimelineValue;
 }
 void Renderer::SubmitAndPresent(uint32_t imageIndex) {
-    // End rendering.
-    cmdBuffers[currentFrame].endRendering();
-    command.TransitionImage(swapchain.images[imageIndex], swapchain.subresourceRange, vk::ImageLayout::eColorAttachmentOptimal, vk::ImageLayout::ePresentSrcKHR, vk::AccessFlagBits2::eColorAttachmentWrite, vk::AccessFlagBits2::eNone);
-    command.TransitionImage(depthImages[imageIndex].image, depthSubresourceRange, vk::ImageLayout::eDepthStencilAttachmentOptimal, vk::ImageLayout::ePresentSrcKHR,
-        vk::AccessFlagBits2::eDepthStencilAttachmentRead | vk::AccessFlagBits2::eDepthStencilAttachmentWrite, vk::AccessFlagBits2::eNone);
-    cmdBuffers[currentFrame].end();
-    // Submit work.
-    vk::PipelineStageFlags waitStage = vk::PipelineStageFlagBits::eColorAttachmentOutput;
-    vk::SubmitInfo submitInfo = vk::SubmitInfo()
-        .setCommandBuffers(cmdBuffers[currentFrame])
-        .setWaitSemaphores(imageAquiredSemaphores[currentFrame])
-        .setSignalSemaphores(renderFinishedSemaphores[currentFrame])
-        .setWaitDstStageMask(waitStage);
-    graphicsQueue.submit(submitInfo, inFlightFences[currentFrame]);
-
-    // Present image.
+    PROFILE_ZONE("Submit and present");
+    const bool headless = swapchain.IsHeadless();
+    if (imageIndex != UINT32_MAX && headless) {
+        // Left ready to be read back, nothing presents it.
+        command.TransitionImage(swapchain.images[imageIndex], swapchain.subresourceRange, vk::ImageLayout::eColorAttachmentOptimal, vk::ImageLayout::eTransferSrcOptimal, vk::AccessFlagBits2::eColorAttachmentWrite, vk::AccessFlagBits2::eNone);
+    }
+    else if (imageIndex != UINT32_MAX) {
+        command.TransitionImage(swapchain.images[imageIndex], swapchain.subresourceRange, vk::ImageLayout::eColorAttachmentOptimal, vk::ImageLayout::ePresentSrcKHR, vk::AccessFlagBits2::eColorAttachmentWrite, vk::AccessFlagBits2::eNone);
+        command.TransitionImage(frames[currentFrame].depthImage.image, depthSubresourceRange, vk::ImageLayout::eDepthStencilAttachmentOptimal, vk::ImageLayout::ePresentSrcKHR,
+            vk::AccessFlagBits2::eDepthStencilAttachmentRead | vk::AccessFlagBits2::eDepthStencilAttachmentWrite, vk::AccessFlagBits2::eNone);
+    }
+    frames[currentFrame].cmdBuffer.end();
+    // The value is taken here, so it stays in order with SubmitImmediate even when the submission thread is behind.
+    frames[currentFrame].timelineValue = ++submittedTimelineValue;
+    // Only frames with an image acquired from the current swapchain get here, a failed acquire recreates it before submitting.
+    if (imageIndex != UINT32_MAX) {
+        for (auto& retired : retiredSwapchains)
+            deletionQueue.PushCallback(frames[currentFrame].timelineValue, [this, retired]() mutable { swapchain.Destroy(retired); });
+        retiredSwapchains.clear();
+    }
+    FramePacket packet{
+        frames[currentFrame].cmdBuffer,
+        frames[currentFrame].imageAquiredSemaphore,
+        imageIndex != UINT32_MAX && !headless ? renderFinishedSemaphores[imageIndex] : vk::Semaphore(),
+        swapchain.swapchain,
+        imageIndex,
+        frames[currentFrame].timelineValue,
+        imageIndex != UINT32_MAX && device.supportsPresentWait ? ++presentId : 0,
+        inputTime,
+        inputEventTime
+    };
+    if (submitThread.joinable()) {
+        // Counted first, the submission thread may only run dry once the packet was taken.
+        pendingSubmits++;
+        while (!submitQueue.Push(packet))
+            std::this_thread::yield();
+        pendingSubmits.notify_all();
+        pushedSubmits++;
+        pushedSubmits.notify_one();
+    }
+    else
+        SubmitFrame(packet);
+
+    if (requestNewSwapchain)
+        RecreateSwapchain();
+    currentFrame = (currentFrame + 1) % frames.size();
+}
+void Renderer::SubmitFrame(const FramePacket& packet) {
+    PROFILE_ZONE("Submit frame");
+    const bool present = packet.imageIndex != UINT32_MAX && packet.swapchain;
+    // Presentation still needs a binary semaphore, the timeline tracks completion.
+    auto cmdBufferInfo = vk::CommandBufferSubmitInfo()
+        .setCommandBuffer(packet.cmdBuffer);
+    auto waitInfo = vk::SemaphoreSubmitInfo()
+        .setSemaphore(packet.imageAquiredSemaphore)
+        .setStageMask(vk::PipelineStageFlagBits2::eColorAttachmentOutput);
+    std::array<vk::SemaphoreSubmitInfo, 2> signalInfos = {
+        vk::SemaphoreSubmitInfo()
+            .setSemaphore(graphicsTimeline)
+            .setValue(packet.timelineValue)
+            .setStageMask(vk::PipelineStageFlagBits2::eAllCommands),
+        vk::SemaphoreSubmitInfo()
+            .setSemaphore(packet.renderFinishedSemaphore)
+            .setStageMask(vk::PipelineStageFlagBits2::eAllCommands)
+    };
+    auto submitInfo = vk::SubmitInfo2()
+        .setCommandBufferInfos(cmdBufferInfo)
+        .setWaitSemaphoreInfoCount(present ? 1 : 0)
+        .setPWaitSemaphoreInfos(&waitInfo)
+        .setSignalSemaphoreInfoCount(present ? 2 : 1)
+        .setPSignalSemaphoreInfos(signalInfos.data());
+
+    std::lock_guard<std::mutex> queueLock(queueMutex);
+    inputToSubmitTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - packet.inputTime).count();
+    if (packet.eventTime)
+        eventToSubmitTime = (SDL_GetTicksNS() - packet.eventTime) / 1000000.0;
+    graphicsQueue.submit2(submitInfo);
+    if (!present)
+        return;
+
+    auto presentIdInfo = vk::PresentIdKHR()
+        .setPresentIds(packet.presentId);
     vk::PresentInfoKHR info = vk::PresentInfoKHR()
-        .setSwapchains(swapchain.swapchain)
-        .setImageIndices(imageIndex)
-        .setWaitSemaphores(renderFinishedSemaphores[currentFrame]);
+        .setSwapchains(packet.swapchain)
+        .setImageIndices(packet.imageIndex)
+        .setWaitSemaphores(packet.renderFinishedSemaphore)
+        .setPNext(packet.presentId ? &presentIdInfo : nullptr);
+    std::lock_guard<std::mutex> swapchainLock(swapchainMutex);
     try {
-        graphicsQueue.presentKHR(info);
+        if (graphicsQueue.presentKHR(info) == vk::Result::eSuboptimalKHR)
+            requestNewSwapchain = true;
     }
-    catch (std::exception e) {
+    catch (const std::exception&) {
         requestNewSwapchain = true;
     }
-    if (requestNewSwapchain) {
-        requestNewSwapchain = false;
-        device.device.waitForFences(inFlightFences[currentFrame], false, UINT64_MAX);
-        device.device.resetFences  (inFlightFences[currentFrame]);
-        device.device.resetCommandPool(command.cmdPool);
-        swapchain.Recreate(instance.pWindow, doVsync);
+}
+void Renderer::SubmitLoop() {
+    Profiler::SetThreadName("Submit");
+    // Sleeps until a packet is in the queue, a frame that is only counted so far must not make it spin.
+    uint64_t popped = 0;
+    while (!stopSubmitThread) {
+        pushedSubmits.wait(popped);
+        FramePacket packet;
+        while (popped < pushedSubmits && submitQueue.Pop(packet)) {
+            popped++;
+            SubmitFrame(packet);
+            pendingSubmits--;
+            pendingSubmits.notify_all();
+        }
+    }
+}
+void Renderer::WaitSubmitIdle() {
+    PROFILE_ZONE("Wait for submission thread");
+    for (uint32_t pending = pendingSubmits; pending != 0; pending = pendingSubmits)
+        pendingSubmits.wait(pending);
+}
+uint64_t Renderer::NextTimelineValue() {
+    return submittedTimelineValue + 1;
+}
+bool Renderer::IsComplete(uint64_t timelineValue) {
+    if (timelineValue <= completedTimelineValue)
+        return true;
+    return timelineValue <= GetCompletedTimelineValue();
+}
+uint64_t Renderer::GetCompletedTimelineValue() {
+    completedTimelineValue = device.device.getSemaphoreCounterValue(graphicsTimeline);
+    return completedTimelineValue;
+}
+void Renderer::WaitTimeline(uint64_t timelineValue) {
+    if (IsComplete(timelineValue))
         return;
+    PROFILE_ZONE("Wait for GPU");
+    auto waitInfo = vk::SemaphoreWaitInfo()
+        .setSemaphores(graphicsTimeline)
+        .setValues(timelineValue);
+    if (device.device.waitSemaphores(waitInfo, UINT64_MAX) != vk::Result::eSuccess) {
+        std::cout << "Waiting on the graphics timeline failed.\n";
+        throw std::runtime_error("Waiting on the graphics timeline failed.");
     }
-    currentFrame = (currentFrame + 1) % 2;
-    device.device.waitForFences(inFlightFences[currentFrame], false, UINT64_MAX);
-    device.device.resetFences(inFlightFences[currentFrame]);
-    cmdBuffers[currentFrame].reset();
+    completedTimelineValue = std::max(completedTimelineValue, timelineValue);
 }
 
 void Renderer::InitImGui(SDL_Window* window) {
+    PROFILE_ZONE("Init ImGui");
     IMGUI_CHECKVERSION();
     ImGui::CreateContext();
     ImGuiIO& io = ImGui::GetIO();
@@ -218,6 +601,7 @@ void Renderer::InitImGui(SDL_Window* window) {
     clearColorUI = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
 }
 void Renderer::CreatePipeline() {
+    PROFILE_ZONE("Create pipeline");
     auto perspectiveRange = vk::PushConstantRange()
         .setOffset(0)
         .setSize(sizeof(PushConstantData))
@@ -231,20 +615,24 @@ void Renderer::CreatePipeline() {
 }
 void Renderer::CreateFencesAndSemaphores() {
     auto semaphoreInfo = vk::SemaphoreCreateInfo();
-    imageAquiredSemaphores  [0] = device.device.createSemaphore(semaphoreInfo);
-    renderFinishedSemaphores[0] = device.device.createSemaphore(semaphoreInfo);
-    imageAquiredSemaphores  [1] = device.device.createSemaphore(semaphoreInfo);
-    renderFinishedSemaphores[1] = device.device.createSemaphore(semaphoreInfo);
-
-    inFlightFences[1] = device.device.createFence(vk::FenceCreateInfo().setFlags(vk::FenceCreateFlagBits::eSignaled));
-    inFlightFences[0] = device.device.createFence(vk::FenceCreateInfo());
-    immediateFence    = device.device.createFence(vk::FenceCreateInfo());
+    for (auto& frame : frames)
+        frame.imageAquiredSemaphore = device.device.createSemaphore(semaphoreInfo);
+    renderFinishedSemaphores.resize(swapchain.images.size());
+    for (auto& semaphore : renderFinishedSemaphores)
+        semaphore = device.device.createSemaphore(semaphoreInfo);
+
+    // Starts at 0, which every frame that has not been submitted yet waits for.
+    auto timelineInfo = vk::SemaphoreTypeCreateInfo()
+        .setSemaphoreType(vk::SemaphoreType::eTimeline)
+        .setInitialValue(0);
+    graphicsTimeline = device.device.createSemaphore(vk::SemaphoreCreateInfo().setPNext(&timelineInfo));
 }
 void Renderer::InitMainObjects(SDL_Window* window, std::atomic<bool>* ready) {
+    PROFILE_ZONE("Init main objects");
     frameTimer = Timer();
-    instance = Instance(window, ready);
+    instance = Instance(settings.headless ? nullptr : window, ready);
     dldid = vk::detail::DispatchLoaderDynamic(instance.instance, vkGetInstanceProcAddr);
-    device = Device(instance.instance);
+    device = Device(instance.instance, settings.headless);
 
     // Create allocator for data transfer to GPU.
     VmaVulkanFunctions vkFuncs = {};
@@ -258,6 +646,7 @@ void Renderer::InitMainObjects(SDL_Window* window, std::atomic<bool>* ready) {
     allocInfo.physicalDevice = device.physicalDevice;
     allocInfo.pVulkanFunctions = &vkFuncs;
     vmaCreateAllocator(&allocInfo, &allocator);
+    deletionQueue = DeletionQueue(device.device, allocator);
 
     depthSubresourceRange = vk::ImageSubresourceRange()
         .setAspectMask(vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil)
@@ -266,19 +655,46 @@ void Renderer::InitMainObjects(SDL_Window* window, std::atomic<bool>* ready) {
         .setLayerCount(1)
         .setLevelCount(1);
 
-    swapchain = Swapchain(&device.device, device.physicalDevice, instance.surface);
-    for (auto& i : depthImages)
-        i = CreateDepthImage();
-
+    // Depth is only touched by the frame that renders, so it follows the frames in flight rather than the swapchain images.
+    frames.resize(std::clamp(settings.framesInFlight, 1u, MAX_FRAMES_IN_FLIGHT));
+    if (settings.headless)
+        CreateOffscreenTargets_Init();
+    else
+        swapchain = Swapchain(&device.device, device.physicalDevice, instance.surface, settings.swapchainImageCount, settings.presentMode);
     graphicsQueue = device.device.getQueue(device.graphicsQueueFamilyIndex, 0);
-    command = Command(device);
-    cmdBuffers[0] = command.cmdBuffer[0];
-    cmdBuffers[1] = command.cmdBuffer[1];
+    // Every worker may record, so each gets its own command pools.
+    command = Command(device, frames.size(), jobSystem.GetWorkerCount());
+    for (size_t i = 0; i < frames.size(); i++) {
+        frames[i].cmdBuffer  = command.cmdBuffer[i];
+        frames[i].depthImage = CreateDepthImage();
+    }
+    std::cout << frames.size() << " frames in flight, " << swapchain.images.size() << " swapchain images, " << jobSystem.GetWorkerCount() << " workers\n";
+}
+
+void Renderer::CreateOffscreenTargets_Init() {
+    auto subresource = vk::ImageSubresourceRange()
+        .setAspectMask(vk::ImageAspectFlagBits::eColor)
+        .setBaseMipLevel(0)
+        .setBaseArrayLayer(0)
+        .setLayerCount(1)
+        .setLevelCount(1);
+    // One per frame in flight at least, so no two frames the GPU may overlap share a target.
+    std::vector<vk::Image> images;
+    std::vector<vk::ImageView> views;
+    const uint32_t count = std::max<uint32_t>(settings.swapchainImageCount, frames.size());
+    for (uint32_t i = 0; i < count; i++) {
+        offscreenImages.emplace_back(CreateImage(vk::Format::eR8G8B8A8Srgb, settings.headlessExtent,
+            vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc, subresource));
+        images.emplace_back(offscreenImages.back().image);
+        views.emplace_back(offscreenImages.back().view);
+    }
+    swapchain = Swapchain(settings.headlessExtent, vk::Format::eR8G8B8A8Srgb, images, views);
+    std::cout << "Rendering headless into " << count << " offscreen " << settings.headlessExtent.width << "x" << settings.headlessExtent.height << " targets\n";
 }
 
-// Read 3D model
+// Read 3D model, the returned span views the loaded glTF buffer directly.
 template<typename T>
-std::vector<T> ReadAttribute(const fastgltf::Asset& asset, const fastgltf::Primitive& primitive, std::string_view Attribute) {
+std::span<const T> ReadAttribute(const fastgltf::Asset& asset, const fastgltf::Primitive& primitive, std::string_view Attribute) {
     const auto& iterator = primitive.findAttribute(Attribute);
     assert(iterator != nullptr);
 
@@ -288,11 +704,9 @@ std::vector<T> ReadAttribute(const fastgltf::Asset& asset, const fastgltf::Primi
     const auto& buffer = asset.buffers[bufferView.bufferIndex];
     const auto& data = get<fastgltf::sources::Array>(buffer.data);
 
-    std::vector<T> out(acr.count);
-    std::memcpy(out.data(), data.bytes.data() + bufferView.byteOffset + acr.byteOffset, acr.count * sizeof(T));
-    return out;
+    return std::span<const T>(reinterpret_cast<const T*>(data.bytes.data() + bufferView.byteOffset + acr.byteOffset), acr.count);
 }
-uint32_t Renderer::ParseGLTFImage(const fastgltf::TextureInfo& imageInfo, const fastgltf::Asset& asset, std::vector<AllocatedImage>& textures) {
+uint32_t Renderer::ParseGLTFImage(const fastgltf::TextureInfo& imageInfo, const fastgltf::Asset& asset, std::vector<AllocatedImage>& textures, TextureUsage usage) {
     const auto& texture          = asset.textures[imageInfo.textureIndex];
     const auto& image            = asset.images[texture.imageIndex.value()];
     const auto& sourceBufferView = get<fastgltf::sources::BufferView>(image.data);
@@ -303,12 +717,15 @@ uint32_t Renderer::ParseGLTFImage(const fastgltf::TextureInfo& imageInfo, const
 
     std::vector<unsigned char> imageChars(imageBufferView.byteLength);
     std::memcpy(imageChars.data(), imageData.bytes.data() + imageBufferView.byteOffset, imageBufferView.byteLength);
-    unsigned char* pixels;
     if (sourceBufferView.mimeType == fastgltf::MimeType::JPEG || sourceBufferView.mimeType == fastgltf::MimeType::PNG) {
-        int width, height, comp;
-        pixels = stbi_load_from_memory(imageChars.data(), imageBufferView.byteLength, &width, &height, &comp, STBI_rgb_alpha);
-        textures.emplace_back(CreateUploadImage(pixels, vk::Format::eR8G8B8A8Unorm, vk::Extent2D{ static_cast<uint32_t>(width), static_cast<uint32_t>(height) }, vk::ImageUsageFlagBits::eSampled));
-        stbi_image_free(pixels);
+        // Reserve the slot now, decoding and encoding happen for all textures at once in LoadTextures_Init.
+        const uint32_t slot = textureSlots.Allocate();
+        if (slot == UINT32_MAX) {
+            std::cout << "Texture table is full, texture " << imageInfo.textureIndex << " is skipped.\n";
+            return 0;
+        }
+        pendingTextures.emplace_back(std::move(imageChars), usage, slot);
+        return slot;
     }
     else if (sourceBufferView.mimeType == fastgltf::MimeType::KTX2) {
         //ktxTexture* textureKTX;
@@ -320,11 +737,10 @@ uint32_t Renderer::ParseGLTFImage(const fastgltf::TextureInfo& imageInfo, const
         //ktxTexture_Destroy(textureKTX);
         return 0;
     }
-    else
-        return 0;
-    return textures.size() - 1;
+    return 0;
 }
-void Renderer::LoadGLTF(std::filesystem::path path, glm::mat4 transform) {
+void Renderer::LoadGLTF(std::filesystem::path path, glm::mat4 transform, bool loadGeometry) {
+    PROFILE_ZONE("Load glTF");
     Timer total = Timer();
     Timer parts = Timer();
     auto data = fastgltf::GltfDataBuffer::FromPath(path);
@@ -395,60 +811,63 @@ void Renderer::LoadGLTF(std::filesystem::path path, glm::mat4 transform) {
     }
     // Load materials.
     std::vector<uint32_t> materialIDs;
-    std::vector<MaterialIndexGroup> matIndexGroups;
     for (const auto& material : asset.materials) {
-        MaterialIndexGroup materialIndices;
         const auto& pbrData = material.pbrData;
+        // Untextured channels point at the white texture, so forcing texture sampling still renders the same image.
+        Material mat = { 2, 2, 2, 0 };
+        mat.baseColorFactor = glm::packUnorm4x8(glm::vec4(pbrData.baseColorFactor.x(), pbrData.baseColorFactor.y(), pbrData.baseColorFactor.z(), pbrData.baseColorFactor.w()));
+        mat.metallicFactor  = pbrData.metallicFactor;
+        mat.roughnessFactor = pbrData.roughnessFactor;
+        mat.emissiveFactor  = glm::packUnorm4x8(glm::vec4(material.emissiveFactor.x(), material.emissiveFactor.y(), material.emissiveFactor.z(), 1));
+
+        // A texture that failed to load falls back to the factor alone.
+        auto parseTexture = [&](const auto& info, uint32_t& index, uint32_t flag, TextureUsage usage) {
+            if (!info.has_value())
+                return;
+            uint32_t texture = ParseGLTFImage(info.value(), asset, textures, usage);
+            if (texture == 0)
+                return;
+            index      = texture;
+            mat.flags |= flag;
+        };
+        parseTexture(pbrData.baseColorTexture,         mat.diffuse,           MATERIAL_HAS_DIFFUSE,            TextureUsage::eBaseColor);
+        parseTexture(pbrData.metallicRoughnessTexture, mat.metallicRoughness, MATERIAL_HAS_METALLIC_ROUGHNESS, TextureUsage::eMetallicRoughness);
+        parseTexture(material.emissiveTexture,         mat.emissive,          MATERIAL_HAS_EMISSIVE,           TextureUsage::eEmissive);
 
-        if (pbrData.baseColorTexture.has_value())
-            materialIndices.diffuse = ParseGLTFImage(pbrData.baseColorTexture.value(), asset, textures);
-        else
-            materialIndices.diffuse = 0;
-
-        if (pbrData.metallicRoughnessTexture.has_value())
-            materialIndices.metallicRoughness = ParseGLTFImage(pbrData.metallicRoughnessTexture.value(), asset, textures);
-        else
-            materialIndices.metallicRoughness = 1;
-
-        if (material.emissiveTexture.has_value())
-            materialIndices.emissive = ParseGLTFImage(material.emissiveTexture.value(), asset, textures);
-        else
-            materialIndices.emissive = 1;
-
-        materialIDs.emplace_back(materialIndexGroups.size());
-        materialIndexGroups.emplace_back(materialIndices);
+        materialIDs.emplace_back(materials.size());
+        materials.emplace_back(mat);
+    }
+    // Meshlets carry the material in the upper bits of their counts, anything past them would shade with another material.
+    if (materials.size() > MAX_MATERIALS) {
+        std::cout << "Scene has " << materials.size() << " materials, meshlets can only address " << MAX_MATERIALS << "\n";
+        throw std::runtime_error("Scene has more materials than meshlets can address.");
     }
     std::cout << "Took " << parts.GetMilliseconds() << " ms to load materials." << "\n";
     parts.Reset();
-    // Load meshes.
+    // Load meshes, unless the processed geometry comes from the scene cache.
+    if (!loadGeometry) {
+        std::cout << "Took " << total.GetMilliseconds() << " ms to load model without geometry." << "\n\n";
+        return;
+    }
     for (const auto& mesh : asset.meshes) {
-        MeshView meshView;
-        meshView.start = indices.size();
         for (const auto& primitive : mesh.primitives) {
+            MeshView meshView;
+            meshView.start = indices.size();
             size_t prevVertexSize = vertices.size();
             size_t prevIndexSize  = indices.size();
 
-            auto positions        = ReadAttribute<glm::vec3>(asset, primitive, "POSITION");
-            auto normals          = ReadAttribute<glm::vec3>(asset, primitive, "NORMAL");
+            const auto& positions = ReadAttribute<glm::vec3>(asset, primitive, "POSITION");
+            const auto& normals   = ReadAttribute<glm::vec3>(asset, primitive, "NORMAL");
             const auto& texCoords = ReadAttribute<glm::vec2>(asset, primitive, "TEXCOORD_0");
 
-            std::cout << "Took " << parts.GetMilliseconds() << " ms to read attributes." << "\n";
-            parts.Reset();
-
-            for (size_t t = 0; t < positions.size(); t++) {
-                auto pos = transform * glm::vec4(positions[t], 1);
-                positions[t] = pos.xyz;
-                normals[t]   = normalTransform * normals[t];
-            }
-
-            std::cout << "Took " << parts.GetMilliseconds() << " ms to transform normals and positions." << "\n";
-            parts.Reset();
-
-            // Add vertices to pool.
+            // Transform and interleave straight from the glTF buffer into the vertex pool.
             size_t vertOffset = vertices.size();
             vertices.resize(vertOffset + positions.size());
-            for (size_t i = 0; i < positions.size(); i++)
-                vertices[i + vertOffset] = { positions[i], texCoords[i].x, normals[i], texCoords[i].y };
+            for (size_t i = 0; i < positions.size(); i++) {
+                auto pos = transform * glm::vec4(positions[i], 1);
+                vertices[i + vertOffset] = { pos.xyz, texCoords[i].x, normalTransform * normals[i], texCoords[i].y };
+            }
+            vertexCopyBytes += positions.size() * sizeof(Vertex);
 
             std::cout << "Took " << parts.GetMilliseconds() << " ms to add vertices." << "\n";
             parts.Reset();
@@ -471,28 +890,23 @@ void Renderer::LoadGLTF(std::filesystem::path path, glm::mat4 transform) {
             size_t indexCount = indAcr.count;
             indices.resize(indexCount + indices.size());
 
-            size_t count = 0;
             // If possible, the GLTF will use uint16 to reduce file size.
+            const auto* rawIndexData = indData.bytes.data() + indAcr.byteOffset + indBufferView.byteOffset;
             if (indAcr.componentType == fastgltf::ComponentType::UnsignedShort) {
-                std::vector<uint16_t> rawIndices(indAcr.count);
-                std::memcpy(rawIndices.data(), indData.bytes.data() + indAcr.byteOffset + indBufferView.byteOffset, sizeof(uint16_t) * rawIndices.size());
-
+                const auto* rawIndices = reinterpret_cast<const uint16_t*>(rawIndexData);
                 for (size_t i = 0; i < indexCount; i++) {
                     indices[prevIndexSize + i] = prevVertexSize + static_cast<uint32_t>(rawIndices[i]);
                 }
             }
             else {
-                std::vector<uint32_t> rawIndices(indAcr.count);
-                std::memcpy(rawIndices.data(), indData.bytes.data() + indAcr.byteOffset + indBufferView.byteOffset, sizeof(uint32_t) * rawIndices.size());
-
-                // TODO: Do memcpy instead.
+                const auto* rawIndices = reinterpret_cast<const uint32_t*>(rawIndexData);
                 for (size_t i = 0; i < indexCount; i++) {
                     indices[prevIndexSize + i] = prevVertexSize + rawIndices[i];
                 }
             }
             meshView.end = indices.size() - 1;
-            meshView.filler = 0;
-            meshView.material = 0;
+            meshView.meshletCount = 0;
+            meshView.material     = virtualMaterialIndex;
             meshViews.emplace_back(meshView);
 
             std::cout << "Took " << parts.GetMilliseconds() << " ms to format and add indices." << "\n";
@@ -500,73 +914,216 @@ void Renderer::LoadGLTF(std::filesystem::path path, glm::mat4 transform) {
     }
     std::cout << "Took " << total.GetMilliseconds() << " ms to fully load model." << "\n\n";
 }
+// Spreads the lower 10 bits of v out so there are two zero bits between each of them.
+uint32_t ExpandBits(uint32_t v) {
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+}
+// 30-bit Morton code of a position normalized to [0, 1].
+uint32_t MortonCode(glm::vec3 position) {
+    const auto cell = glm::uvec3(glm::clamp(position * 1024.0f, glm::vec3(0.0f), glm::vec3(1023.0f)));
+    return (ExpandBits(cell.x) << 2) | (ExpandBits(cell.y) << 1) | ExpandBits(cell.z);
+}
+// Average diagonal of the box around each group of meshlets a task workgroup would cull together.
+float AverageGroupExtent(const std::vector<meshopt_Bounds>& bounds) {
+    if (bounds.empty())
+        return 0;
+    double totalExtent = 0;
+    size_t groupCount  = 0;
+    for (size_t first = 0; first < bounds.size(); first += TASK_GROUP_MESHLETS, groupCount++) {
+        glm::vec3 minCorner = glm::vec3(FLT_MAX), maxCorner = glm::vec3(-FLT_MAX);
+        for (size_t i = first; i < std::min(first + TASK_GROUP_MESHLETS, bounds.size()); i++) {
+            minCorner = glm::min(minCorner, glm::make_vec3(bounds[i].center) - bounds[i].radius);
+            maxCorner = glm::max(maxCorner, glm::make_vec3(bounds[i].center) + bounds[i].radius);
+        }
+        totalExtent += glm::length(maxCorner - minCorner);
+    }
+    return totalExtent / groupCount;
+}
+// Material changes between neighbouring meshlets of the same task workgroup, when the views are dispatched in this order.
+uint32_t CountMaterialSwitches(const std::vector<MeshView>& views) {
+    uint32_t switches = 0;
+    size_t meshlet = 0;
+    for (size_t v = 0; v < views.size(); v++) {
+        meshlet += views[v].meshletCount;
+        // Only the boundary between two views can switch material.
+        if (v + 1 < views.size() && views[v].material != views[v + 1].material && meshlet % TASK_GROUP_MESHLETS != 0)
+            switches++;
+    }
+    return switches;
+}
 void Renderer::OptimizeMesh() {
+    PROFILE_ZONE("Optimize mesh");
     {
         // Indexing.
+        PROFILE_ZONE("Index");
         Timer timer = Timer();
         std::vector<uint32_t> remap(indices.size());
-        std::vector<uint32_t> newIndices(indices.size());
 
         size_t oldVertCount = vertices.size();
         size_t vertCount    = meshopt_generateVertexRemap(remap.data(), indices.data(), indices.size(), vertices.data(), oldVertCount, sizeof(Vertex));
         std::vector<Vertex> newVertices(vertCount);
 
-        meshopt_remapIndexBuffer (newIndices.data(), indices.data(), indices.size(), remap.data());
+        meshopt_remapIndexBuffer (indices.data(), indices.data(), indices.size(), remap.data());
         meshopt_remapVertexBuffer(newVertices.data(), vertices.data(), oldVertCount, sizeof(Vertex), remap.data());
+        vertexCopyBytes += vertCount * sizeof(Vertex);
         std::cout << "Reduced vertex count by " << oldVertCount - newVertices.size() << " in " << timer.GetMilliseconds() << " ms" << "\n";
-        vertices = newVertices;
-        indices  = newIndices;
+        vertices = std::move(newVertices);
     }
     {
         // Vertex cache optimization. (Questionable, seems to degrade performance)
+        // Done per mesh view so triangles never move between views.
+        PROFILE_ZONE("Vertex cache");
         Timer timer = Timer();
-        meshopt_optimizeVertexCache(indices.data(), indices.data(), indices.size(), vertices.size());
+        for (const auto& view : meshViews)
+            meshopt_optimizeVertexCache(&indices[view.start], &indices[view.start], view.end + 1 - view.start, vertices.size());
         std::cout << "Reordered indices in " << timer.GetMilliseconds() << " ms" << "\n";
     }
     std::vector<float> positions(vertices.size() * 3);
     for (size_t i = 0; i < vertices.size(); i++) {
-        positions[i] = vertices[i].Position.x;
-        positions[i + 1] = vertices[i].Position.y;
-        positions[i + 2] = vertices[i].Position.z;
+        positions[i * 3]     = vertices[i].Position.x;
+        positions[i * 3 + 1] = vertices[i].Position.y;
+        positions[i * 3 + 2] = vertices[i].Position.z;
     }
     {
         // Overdraw optimization.
+        PROFILE_ZONE("Overdraw");
         Timer timer = Timer();
-        meshopt_optimizeOverdraw(indices.data(), indices.data(), indices.size(), positions.data(), vertices.size(), sizeof(float) * 3, 1.05f);
+        for (const auto& view : meshViews)
+            meshopt_optimizeOverdraw(&indices[view.start], &indices[view.start], view.end + 1 - view.start, positions.data(), vertices.size(), sizeof(float) * 3, 1.05f);
         std::cout << "Optimized overdraw in " << timer.GetMilliseconds() << " ms" << "\n";
     }
     {
         // Vertex fetch optimization.
+        PROFILE_ZONE("Vertex fetch");
+        // The reordered vertices are gathered straight into GPU visible memory, so they are written sequentially exactly once.
         Timer timer = Timer();
-        meshopt_optimizeVertexFetch(vertices.data(), indices.data(), indices.size(), vertices.data(), vertices.size(), sizeof(Vertex));
-        std::cout << "Reordered vertices in " << timer.GetMilliseconds() << " ms" << "\n";
+        std::vector<uint32_t> remap(vertices.size());
+        size_t vertCount = meshopt_optimizeVertexFetchRemap(remap.data(), indices.data(), indices.size(), vertices.size());
+        meshopt_remapIndexBuffer(indices.data(), indices.data(), indices.size(), remap.data());
+
+        std::vector<uint32_t> order(vertCount);
+        for (size_t i = 0; i < remap.size(); i++)
+            if (remap[i] != ~0u)
+                order[remap[i]] = i;
+
+        auto vertexTarget = BeginUpload(vertCount * sizeof(Vertex));
+        auto* gpuVertices = reinterpret_cast<Vertex*>(vertexTarget.pMapped);
+        std::vector<float> newPositions(vertCount * 3);
+        for (size_t i = 0; i < vertCount; i++) {
+            gpuVertices[i] = vertices[order[i]];
+            std::memcpy(&newPositions[i * 3], &positions[order[i] * 3], sizeof(float) * 3);
+        }
+        vertexCopyBytes += vertexTarget.size;
+        meshBuffer = FinishUpload(vertexTarget);
+        positions  = std::move(newPositions);
+
+        // The cache encodes straight from the same gather, so no reordered copy is built for it.
+        if (settings.useSceneCache)
+            sceneCache.SetStream(SceneStream::eVertices, vertices.data(), order, sizeof(Vertex));
+        // Unless they are retained, the reordered vertices only exist in GPU memory from here on.
+        if (settings.sceneResidency == SceneResidency::eRetain) {
+            std::vector<Vertex> newVertices(vertCount);
+            for (size_t i = 0; i < vertCount; i++)
+                newVertices[i] = vertices[order[i]];
+            vertices = std::move(newVertices);
+            vertexCopyBytes += vertCount * sizeof(Vertex);
+        }
+        else {
+            vertices.clear();
+            vertices.shrink_to_fit();
+        }
+        std::cout << "Reordered and uploaded " << vertCount << " vertices " << (vertexTarget.isDirect ? "directly" : "through staging")
+            << " in " << timer.GetMilliseconds() << " ms" << "\n";
+        std::cout << "Vertex data was copied " << static_cast<double>(vertexCopyBytes) / vertexTarget.size << " times on the CPU ("
+            << vertexCopyBytes << " Bytes)" << (settings.sceneResidency == SceneResidency::eRetain ? ", the retained copy included\n" : " before reaching GPU visible memory\n");
     }
     {
-        // Build and optimize meshlets.
+        // Build and optimize meshlets, per mesh view so no meshlet spans two meshes.
+        PROFILE_ZONE("Build meshlets");
         Timer timer = Timer();
         const size_t maxVertices  = 64;
         const size_t maxTriangles = 124;
         const float  coneWeight   = 0.25f;
-        size_t maxMeshlets = meshopt_buildMeshletsBound(indices.size(), maxVertices, maxTriangles);
-        meshlets         = std::vector<meshopt_Meshlet>(maxMeshlets);
-        meshletVertices  = std::vector<uint32_t>(maxMeshlets * maxVertices);
-        meshletTriangles = std::vector<uint8_t>(maxMeshlets * maxTriangles * 3);
-
-        size_t meshletCount = meshopt_buildMeshlets(meshlets.data(), meshletVertices.data(), meshletTriangles.data(), indices.data(),
-            indices.size(), positions.data(), vertices.size(), sizeof(float) * 3, maxVertices, maxTriangles, coneWeight);
-
-        const meshopt_Meshlet& lastElement = meshlets[meshletCount - 1];
-        meshletVertices.resize(lastElement.vertex_offset + lastElement.vertex_count);
-        meshletTriangles.resize(lastElement.triangle_offset + ((lastElement.triangle_count * 3 + 3) & ~3));
+        const size_t vertexCount  = positions.size() / 3;
+
+        std::vector<meshopt_Meshlet> viewMeshlets;
+        std::vector<uint32_t>        viewVertices;
+        std::vector<uint8_t>         viewTriangles;
+        std::vector<meshopt_Bounds>  buildOrderBounds;
+        std::vector<meshopt_Bounds>  sortedBounds;
+        std::vector<uint32_t>        meshletMaterials;
+        meshlets.clear();
+        meshletVertices.clear();
+        meshletTriangles.clear();
+
+        // Views are emitted grouped by material, so neighbouring workgroups sample the same textures.
+        std::vector<uint32_t> viewOrder(meshViews.size());
+        std::iota(viewOrder.begin(), viewOrder.end(), 0);
+        std::stable_sort(viewOrder.begin(), viewOrder.end(), [&](uint32_t a, uint32_t b) { return meshViews[a].material < meshViews[b].material; });
+        for (uint32_t v : viewOrder) {
+            auto& view = meshViews[v];
+            const size_t indexCount  = view.end + 1 - view.start;
+            const size_t maxMeshlets = meshopt_buildMeshletsBound(indexCount, maxVertices, maxTriangles);
+            viewMeshlets .resize(maxMeshlets);
+            viewVertices .resize(maxMeshlets * maxVertices);
+            viewTriangles.resize(maxMeshlets * maxTriangles * 3);
+
+            size_t meshletCount = meshopt_buildMeshlets(viewMeshlets.data(), viewVertices.data(), viewTriangles.data(), &indices[view.start],
+                indexCount, positions.data(), vertexCount, sizeof(float) * 3, maxVertices, maxTriangles, coneWeight);
+
+            // Sort the meshlets of this view along a Morton curve through their bounding sphere centres.
+            std::vector<meshopt_Bounds> bounds(meshletCount);
+            glm::vec3 minCentre = glm::vec3(FLT_MAX), maxCentre = glm::vec3(-FLT_MAX);
+            for (size_t i = 0; i < meshletCount; i++) {
+                const auto& m = viewMeshlets[i];
+                bounds[i] = meshopt_computeMeshletBounds(&viewVertices[m.vertex_offset], &viewTriangles[m.triangle_offset], m.triangle_count,
+                    positions.data(), vertexCount, sizeof(float) * 3);
+                minCentre = glm::min(minCentre, glm::make_vec3(bounds[i].center));
+                maxCentre = glm::max(maxCentre, glm::make_vec3(bounds[i].center));
+            }
+            const glm::vec3 scale = 1.0f / glm::max(maxCentre - minCentre, glm::vec3(FLT_EPSILON));
+            std::vector<std::pair<uint32_t, uint32_t>> order(meshletCount);
+            for (size_t i = 0; i < meshletCount; i++)
+                order[i] = { MortonCode((glm::make_vec3(bounds[i].center) - minCentre) * scale), static_cast<uint32_t>(i) };
+            std::stable_sort(order.begin(), order.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+            // Append in sorted order, so the vertex and triangle ranges stay contiguous.
+            for (const auto& [code, i] : order) {
+                auto m = viewMeshlets[i];
+                const size_t vertexOffset   = meshletVertices.size();
+                const size_t triangleOffset = meshletTriangles.size();
+                meshletVertices .insert(meshletVertices.end(),  &viewVertices[m.vertex_offset],    &viewVertices[m.vertex_offset] + m.vertex_count);
+                meshletTriangles.insert(meshletTriangles.end(), &viewTriangles[m.triangle_offset], &viewTriangles[m.triangle_offset] + m.triangle_count * 3);
+                m.vertex_offset   = vertexOffset;
+                m.triangle_offset = triangleOffset;
+                meshlets.emplace_back(m);
+                meshletMaterials.emplace_back(view.material);
+                sortedBounds.emplace_back(bounds[i]);
+            }
+            view.meshletCount = meshletCount;
+            buildOrderBounds.insert(buildOrderBounds.end(), bounds.begin(), bounds.end());
+        }
         std::cout << "Built meshlets in " << timer.GetMilliseconds() << " ms" << "\n";
+        std::cout << "Average extent per " << TASK_GROUP_MESHLETS << " meshlets: " << AverageGroupExtent(buildOrderBounds) << " in build order, "
+            << AverageGroupExtent(sortedBounds) << " in Morton order" << "\n";
+
+        std::vector<MeshView> sortedViews(meshViews.size());
+        for (size_t i = 0; i < viewOrder.size(); i++)
+            sortedViews[i] = meshViews[viewOrder[i]];
+        std::cout << "Material switches within " << TASK_GROUP_MESHLETS << " meshlet workgroups: " << CountMaterialSwitches(meshViews)
+            << " in load order, " << CountMaterialSwitches(sortedViews) << " grouped by material" << "\n";
+        meshViews = std::move(sortedViews);
         timer.Reset();
-        //meshopt_optimizeMeshlet(meshletVertices.data(), meshletTriangles.data(), lastElement.triangle_count, lastElement.vertex_count);
+        for (const auto& m : meshlets)
+            meshopt_optimizeMeshlet(&meshletVertices[m.vertex_offset], &meshletTriangles[m.triangle_offset], m.triangle_count, m.vertex_count);
         std::cout << "Optimized meshlets in " << timer.GetMilliseconds() << " ms" << "\n";
         timer.Reset();
-        
-        meshletsAddress         = UploadData<meshopt_Meshlet>(meshlets);
-        meshletVerticesAddress  = UploadData<uint32_t>(meshletVertices);
-        meshletTrianglesAddress = UploadData<uint8_t>(meshletTriangles);
+
+        UploadMeshlets(meshletMaterials);
         std::cout << "Uploaded meshlets in " << timer.GetMilliseconds() << " ms" << "\n";
     }
     {
@@ -575,32 +1132,168 @@ void Renderer::OptimizeMesh() {
     {
         // Vertex quantization.
     }
+    if (settings.useSceneCache) {
+        Timer timer = Timer();
+        sceneCache.SetStream(SceneStream::eMeshViews, meshViews.data(), meshViews.size(), sizeof(MeshView));
+        if (sceneCache.Write())
+            std::cout << "Wrote scene cache in " << timer.GetMilliseconds() << " ms" << "\n";
+        else
+            std::cout << "Could not write scene cache to " << sceneCache.path << "\n";
+    }
+}
+void Renderer::LoadSceneCache_Init() {
+    PROFILE_ZONE("Load scene cache");
+    Timer timer = Timer();
+    const uint32_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+    // Decode every stream straight into its upload target, empty streams get no buffer.
+    auto decodeUpload = [&](SceneStream stream) {
+        if (sceneCache.GetDecodedSize(stream) == 0)
+            return GPUBuffer();
+        auto target = BeginUpload(sceneCache.GetDecodedSize(stream));
+        if (!sceneCache.Decode(stream, target.pMapped, threadCount))
+            throw std::runtime_error("Scene cache is corrupt, delete it to rebuild it from the models.");
+        return FinishUpload(target);
+    };
+    meshBuffer            = decodeUpload(SceneStream::eVertices);
+    meshletBuffer         = decodeUpload(SceneStream::eMeshlets);
+    meshletVertexBuffer   = decodeUpload(SceneStream::eMeshletVertices);
+    meshletTriangleBuffer = decodeUpload(SceneStream::eMeshletTriangles);
+    meshletCount          = sceneCache.GetCount(SceneStream::eMeshlets);
+
+    meshViews.resize(sceneCache.GetCount(SceneStream::eMeshViews));
+    if (!sceneCache.Decode(SceneStream::eMeshViews, meshViews.data(), 1))
+        throw std::runtime_error("Scene cache is corrupt, delete it to rebuild it from the models.");
+
+    size_t encodedSize = 0, decodedSize = 0;
+    for (uint32_t i = 0; i < static_cast<uint32_t>(SceneStream::eCount); i++) {
+        encodedSize += sceneCache.GetEncodedSize(static_cast<SceneStream>(i));
+        decodedSize += sceneCache.GetDecodedSize(static_cast<SceneStream>(i));
+    }
+    std::cout << "Decoded and uploaded scene cache (" << encodedSize << " Bytes -> " << decodedSize << " Bytes) in "
+        << timer.GetMilliseconds() << " ms on " << threadCount << " threads" << "\n";
+
+    if (settings.benchmarkSceneCache)
+        sceneCache.Benchmark(threadCount);
 }
 
+void Renderer::UploadMeshlets(std::span<const uint32_t> meshletMaterials) {
+    PROFILE_ZONE("Upload meshlets");
+    // Vertex references become 16-bit offsets from a per meshlet base and each triangle is packed into a single word,
+    // so the mesh shader does one load per triangle instead of three byte loads.
+    std::vector<PackedMeshlet> packedMeshlets(meshlets.size());
+    std::vector<uint16_t>      packedVertices;
+    std::vector<uint32_t>      packedTriangles;
+    packedVertices.reserve(meshletVertices.size());
+    packedTriangles.reserve(meshletTriangles.size() / 3);
+
+    size_t wideMeshlets = 0;
+    for (size_t i = 0; i < meshlets.size(); i++) {
+        const auto& m     = meshlets[i];
+        const auto  first = meshletVertices.begin() + m.vertex_offset;
+        const auto [minIt, maxIt] = std::minmax_element(first, first + m.vertex_count);
+        const bool wide = *maxIt - *minIt > 0xFFFF;
+
+        auto& packed = packedMeshlets[i];
+        packed.vertexBase     = wide ? 0 : *minIt;
+        packed.vertexOffset   = packedVertices.size();
+        packed.triangleOffset = packedTriangles.size();
+        packed.counts         = m.vertex_count | (m.triangle_count << 8) | (wide ? MESHLET_WIDE_VERTICES : 0) |
+            (meshletMaterials[i] << MESHLET_MATERIAL_SHIFT);
+
+        for (uint32_t v = 0; v < m.vertex_count; v++) {
+            uint32_t offset = meshletVertices[m.vertex_offset + v] - packed.vertexBase;
+            packedVertices.emplace_back(offset & 0xFFFF);
+            if (wide)
+                packedVertices.emplace_back(offset >> 16);
+        }
+        for (uint32_t t = 0; t < m.triangle_count; t++) {
+            const uint8_t* triangle = &meshletTriangles[m.triangle_offset + t * 3];
+            packedTriangles.emplace_back(triangle[0] | (triangle[1] << 8) | (triangle[2] << 16));
+        }
+        wideMeshlets += wide;
+    }
+    // The shaders read the vertex offsets as pairs from 32-bit words.
+    if (packedVertices.size() % 2)
+        packedVertices.emplace_back(0);
+
+    meshletBuffer         = UploadData<PackedMeshlet>(packedMeshlets);
+    meshletVertexBuffer   = UploadData<uint16_t>(packedVertices);
+    meshletTriangleBuffer = UploadData<uint32_t>(packedTriangles);
+    meshletCount          = meshlets.size();
+
+    if (settings.useSceneCache) {
+        sceneCache.SetStream(SceneStream::eMeshlets,         packedMeshlets.data(),  packedMeshlets.size(),      sizeof(PackedMeshlet));
+        sceneCache.SetStream(SceneStream::eMeshletVertices,  packedVertices.data(),  packedVertices.size() / 2,  sizeof(uint32_t));
+        sceneCache.SetStream(SceneStream::eMeshletTriangles, packedTriangles.data(), packedTriangles.size(),     sizeof(uint32_t));
+    }
+
+    const size_t oldBytes = meshletVertices.size() * sizeof(uint32_t) + meshletTriangles.size();
+    const size_t newBytes = packedVertices.size() * sizeof(uint16_t) + packedTriangles.size() * sizeof(uint32_t);
+    std::cout << "Meshlet index data: " << newBytes << " Bytes, was " << oldBytes << " Bytes with 32-bit vertices and byte triangles ("
+        << wideMeshlets << " of " << meshlets.size() << " meshlets need 32-bit vertices)\n";
+}
 template<typename T>
-vk::DeviceAddress Renderer::UploadData(std::span<T> data) {
-    const auto size = sizeof(T) * data.size();
+GPUBuffer Renderer::UploadData(std::span<T> data) {
+    auto target = BeginUpload(sizeof(T) * data.size());
+    std::memcpy(target.pMapped, data.data(), target.size);
+    return FinishUpload(target);
+}
+UploadTarget Renderer::BeginUpload(size_t size) {
+    UploadTarget target = {};
+    target.size = size;
 
-    auto buffer = CreateBuffer(size, vk::BufferUsageFlagBits::eStorageBuffer |
-        vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eShaderDeviceAddress, VMA_MEMORY_USAGE_GPU_ONLY);
-    auto addressInfo = vk::BufferDeviceAddressInfo()
-        .setBuffer(buffer.buffer);
+    // Prefer device local memory the CPU can write to (ReBAR or unified memory),
+    // VMA falls back to device local memory that is only reachable through a transfer.
+    VkBufferCreateInfo bufferInfo = vk::BufferCreateInfo()
+        .setSize(size)
+        .setUsage(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eShaderDeviceAddress);
 
-    AllocatedBuffer stageBuffer = CreateBuffer(size,
-        vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_ONLY);
-    auto byteData = static_cast<std::byte*>(stageBuffer.alloc->GetMappedData());
-    std::memcpy(byteData, data.data(), size);
+    VmaAllocationCreateInfo allocInfo = {};
+    allocInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+    allocInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_ALLOW_TRANSFER_INSTEAD_BIT |
+        VMA_ALLOCATION_CREATE_MAPPED_BIT;
 
-    std::function<void()> func = [&]() {
-        auto region = vk::BufferCopy()
-            .setSize(size);
-        cmdBuffers[currentFrame].copyBuffer(stageBuffer.buffer, buffer.buffer, region);
-        };
-    SubmitImmediate(func);
-    device.device.resetCommandPool(command.cmdPool);
-    vmaDestroyBuffer(allocator, stageBuffer.buffer, stageBuffer.alloc);
+    VkBuffer buffer;
+    vmaCreateBuffer(allocator, &bufferInfo, &allocInfo, &buffer, &target.buffer.alloc, &target.buffer.info);
+    target.buffer.buffer = vk::Buffer(buffer);
+
+    VkMemoryPropertyFlags memoryFlags;
+    vmaGetAllocationMemoryProperties(allocator, target.buffer.alloc, &memoryFlags);
+    target.isDirect = memoryFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+
+    if (target.isDirect)
+        target.pMapped = static_cast<std::byte*>(target.buffer.info.pMappedData);
+    else {
+        // Temporary CPU buffer for sending data.
+        target.staging = CreateBuffer(size, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_ONLY);
+        target.pMapped = static_cast<std::byte*>(target.staging.info.pMappedData);
+    }
+    return target;
+}
+GPUBuffer Renderer::FinishUpload(UploadTarget& target) {
+    if (target.isDirect)
+        vmaFlushAllocation(allocator, target.buffer.alloc, 0, target.size);
+    else {
+        // Not waited on, the barrier makes the copy visible to every later submit on the queue.
+        const uint64_t uploaded = SubmitImmediate([&](vk::CommandBuffer& cmd) {
+            auto region = vk::BufferCopy()
+                .setSize(target.size);
+            cmd.copyBuffer(target.staging.buffer, target.buffer.buffer, region);
+            auto barrier = vk::MemoryBarrier2()
+                .setSrcStageMask(vk::PipelineStageFlagBits2::eTransfer)
+                .setSrcAccessMask(vk::AccessFlagBits2::eTransferWrite)
+                .setDstStageMask(vk::PipelineStageFlagBits2::eAllCommands)
+                .setDstAccessMask(vk::AccessFlagBits2::eMemoryRead);
+            cmd.pipelineBarrier2(vk::DependencyInfo().setMemoryBarriers(barrier));
+            });
+        deletionQueue.PushBuffer(uploaded, target.staging.buffer, target.staging.alloc);
+    }
+    target.pMapped = nullptr;
 
-    return device.device.getBufferAddress(addressInfo);
+    auto addressInfo = vk::BufferDeviceAddressInfo()
+        .setBuffer(target.buffer.buffer);
+    return { target.buffer, device.device.getBufferAddress(addressInfo) };
 }
 AllocatedBuffer Renderer::CreateBuffer(size_t allocSize, vk::Flags<vk::BufferUsageFlagBits> usage, VmaMemoryUsage memUsage) {
     VkBufferCreateInfo bufferInfo = vk::BufferCreateInfo()
@@ -618,40 +1311,6 @@ AllocatedBuffer Renderer::CreateBuffer(size_t allocSize, vk::Flags<vk::BufferUsa
     allocBuffer.buffer = vk::Buffer(buffer);
     return allocBuffer;
 }
-GPUBuffer Renderer::UploadMesh(std::span<Vertex> vertices) {
-    // GPU only buffers.
-    const size_t vertSize = vertices.size() * sizeof(Vertex);
-
-    auto vertBuffer = CreateBuffer(vertSize, vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst |
-        vk::BufferUsageFlagBits::eShaderDeviceAddress, VMA_MEMORY_USAGE_GPU_ONLY);
-
-    auto vertInfo = vk::BufferDeviceAddressInfo()
-        .setBuffer(vertBuffer.buffer);
-
-    GPUBuffer meshbuffer{
-        vertBuffer,
-        device.device.getBufferAddress(vertInfo)
-    };
-
-    // Temporary CPU buffer for sending data.
-    AllocatedBuffer stageBuffer = CreateBuffer(vertSize, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_ONLY);
-    auto data = static_cast<std::byte*>(stageBuffer.alloc->GetMappedData());
-
-    std::memcpy(data, vertices.data(), vertSize);
-
-    std::function<void()> func = [&]() {
-        auto vertRegion = vk::BufferCopy()
-            .setSize(vertSize);
-        cmdBuffers[currentFrame].copyBuffer(stageBuffer.buffer, meshbuffer.buffer.buffer, vertRegion);
-    };
-    SubmitImmediate(func);
-
-    device.device.resetCommandPool(command.cmdPool);
-    vmaDestroyBuffer(allocator, stageBuffer.buffer, stageBuffer.alloc);
-
-    return meshbuffer;
-}
-
 AllocatedImage Renderer::CreateDepthImage() {
     // Get supported depth format.
     std::array<vk::Format, 3> depthFormats = {
@@ -667,20 +1326,17 @@ AllocatedImage Renderer::CreateDepthImage() {
             break;
         }
     }
-    return CreateImage(vk::Format::eD24UnormS8Uint, swapchain.renderExtend, vk::ImageUsageFlagBits::eDepthStencilAttachment, depthSubresourceRange);
+    return CreateImage(depthAttachmentFormat, swapchain.renderExtend, vk::ImageUsageFlagBits::eDepthStencilAttachment, depthSubresourceRange);
 }
-AllocatedImage Renderer::CreateImage(vk::Format format, vk::Extent2D extend, vk::ImageUsageFlags usage, vk::ImageSubresourceRange subresource, bool makeMipmaps) {
-    uint32_t mipLevelCount = 1;
-    if (makeMipmaps)
-        mipLevelCount = static_cast<uint32_t>(std::floor(std::log2(std::max(extend.height, extend.width)))) + 1;
-
+AllocatedImage Renderer::CreateImage(vk::Format format, vk::Extent2D extend, vk::ImageUsageFlags usage, vk::ImageSubresourceRange subresource,
+    const vk::ComponentMapping& components) {
     auto imageInfo = vk::ImageCreateInfo()
         .setArrayLayers(1)
         .setExtent(vk::Extent3D(extend, 1))
         .setFlags(vk::ImageCreateFlags())
         .setFormat(format)
         .setSamples(vk::SampleCountFlagBits::e1)
-        .setMipLevels(mipLevelCount)
+        .setMipLevels(subresource.levelCount)
         .setUsage(usage)
         .setSharingMode(vk::SharingMode::eExclusive)
         .setInitialLayout(vk::ImageLayout::eUndefined)
@@ -697,61 +1353,61 @@ AllocatedImage Renderer::CreateImage(vk::Format format, vk::Extent2D extend, vk:
     auto result = vmaCreateImage(allocator, reinterpret_cast<VkImageCreateInfo*>(&imageInfo), &imageAllocCreateInfo, reinterpret_cast<VkImage*>(&image), &alloc, nullptr);
     
     vk::ImageView imageView;
-    imageView = CreateImageView(image, format, subresource);
+    imageView = CreateImageView(image, format, subresource, components);
     
     return {image, imageView, alloc};
 }
-AllocatedImage Renderer::CreateUploadImage(void* data, vk::Format format, vk::Extent2D extend, vk::ImageUsageFlags usage, bool makeMipmaps) {
-
-    size_t size = extend.height * extend.width * 4;
-    auto upload = CreateBuffer(size, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_TO_GPU);
+AllocatedImage Renderer::CreateUploadImage(const EncodedTexture& texture, vk::ImageUsageFlags usage, uint32_t firstLevel) {
+    AllocatedImage image;
+    AllocatedBuffer staging;
+    const uint64_t uploaded = SubmitImmediate([&](vk::CommandBuffer& cmd) { image = RecordTextureUpload(texture, usage, firstLevel, staging, cmd); });
+    deletionQueue.PushBuffer(uploaded, staging.buffer, staging.alloc);
+    return image;
+}
+AllocatedImage Renderer::RecordTextureUpload(const EncodedTexture& texture, vk::ImageUsageFlags usage, uint32_t firstLevel, AllocatedBuffer& staging, vk::CommandBuffer& cmd) {
+    const auto& baseLevel = texture.levels[firstLevel];
+    const size_t size = texture.data.size() - baseLevel.offset;
+    staging = CreateBuffer(size, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_TO_GPU);
+    std::memcpy(staging.info.pMappedData, texture.data.data() + baseLevel.offset, size);
 
     auto subresourceRange = vk::ImageSubresourceRange()
         .setAspectMask(vk::ImageAspectFlagBits::eColor)
         .setBaseMipLevel(0)
         .setBaseArrayLayer(0)
         .setLayerCount(1)
-        .setLevelCount(1);
-    
-    std::memcpy(upload.info.pMappedData, data, size);
-    auto image = CreateImage(format, extend, usage | vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eTransferSrc, subresourceRange, makeMipmaps);
-    
-    std::function<void()> func = [&]() {
-        command.TransitionImage(image.image, swapchain.subresourceRange, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal,
-            vk::AccessFlagBits2::eNone, vk::AccessFlagBits2::eTransferWrite);
-
+        .setLevelCount(texture.levels.size() - firstLevel);
+    const auto extend = vk::Extent2D{ baseLevel.width, baseLevel.height };
+    auto image = CreateImage(texture.format, extend, usage | vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eTransferSrc, subresourceRange, texture.components);
+
+    // One copy per mip level, all from the same buffer.
+    std::vector<vk::BufferImageCopy> imageCopies;
+    for (uint32_t i = firstLevel; i < texture.levels.size(); i++) {
+        const auto& level = texture.levels[i];
         auto imageSubresource = vk::ImageSubresourceLayers()
             .setAspectMask(vk::ImageAspectFlagBits::eColor)
-            .setMipLevel(0)
+            .setMipLevel(i - firstLevel)
             .setBaseArrayLayer(0)
             .setLayerCount(1);
         auto imageCopy = vk::BufferImageCopy()
-            .setBufferOffset(0)
+            .setBufferOffset(level.offset - baseLevel.offset)
             .setBufferImageHeight(0)
             .setBufferRowLength(0)
-            .setImageExtent(vk::Extent3D(extend, 1))
+            .setImageExtent(vk::Extent3D(level.width, level.height, 1))
             .setImageSubresource(imageSubresource);
-
-        command.cmdBuffer[currentFrame].copyBufferToImage(upload.buffer, image.image, vk::ImageLayout::eTransferDstOptimal, imageCopy);
-        command.TransitionImage(image.image, swapchain.subresourceRange, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal,
-            vk::AccessFlagBits2::eTransferWrite, vk::AccessFlagBits2::eShaderSampledRead);
-    };
-    SubmitImmediate(func);
-    device.device.resetCommandPool(command.cmdPool);
-
+        imageCopies.emplace_back(imageCopy);
+    }
+    command.TransitionImage(cmd, image.image, subresourceRange, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal,
+        vk::AccessFlagBits2::eNone, vk::AccessFlagBits2::eTransferWrite);
+    cmd.copyBufferToImage(staging.buffer, image.image, vk::ImageLayout::eTransferDstOptimal, imageCopies);
+    command.TransitionImage(cmd, image.image, subresourceRange, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal,
+        vk::AccessFlagBits2::eTransferWrite, vk::AccessFlagBits2::eShaderSampledRead);
     return image;
 }
 
-vk::ImageView Renderer::CreateImageView(const vk::Image& image, const vk::Format& format, const vk::ImageSubresourceRange& subresource) {
-    auto identity = vk::ComponentSwizzle::eIdentity;
-    auto compMapping = vk::ComponentMapping()
-        .setA(identity)
-        .setB(identity)
-        .setG(identity)
-        .setR(identity);
-
+vk::ImageView Renderer::CreateImageView(const vk::Image& image, const vk::Format& format, const vk::ImageSubresourceRange& subresource,
+    const vk::ComponentMapping& components) {
     auto imageViewInfo = vk::ImageViewCreateInfo()
-        .setComponents(compMapping)
+        .setComponents(components)
         .setViewType(vk::ImageViewType::e2D)
         .setFormat(format)
         .setImage(image)
@@ -759,7 +1415,16 @@ vk::ImageView Renderer::CreateImageView(const vk::Image& image, const vk::Format
     return device.device.createImageView(imageViewInfo);
 }
 
+// Texture with only a base level, for data that is already in its final format.
+EncodedTexture SingleLevelTexture(const void* data, size_t size, vk::Format format, uint32_t width, uint32_t height) {
+    EncodedTexture texture;
+    texture.data.assign(static_cast<const unsigned char*>(data), static_cast<const unsigned char*>(data) + size);
+    texture.levels = { { width, height, 0, size } };
+    texture.format = format;
+    return texture;
+}
 void Renderer::CreateDebugTextures() {
+    PROFILE_ZONE("Create debug textures");
     uint32_t magenta = glm::packUnorm4x8(glm::vec4(1, 0, 1, 1));
     uint32_t black = glm::packUnorm4x8(glm::vec4(0, 0, 0, 0));
     uint32_t white = glm::packUnorm4x8(glm::vec4(1, 1, 1, 1));
@@ -767,42 +1432,35 @@ void Renderer::CreateDebugTextures() {
     for (size_t x = 0; x < 16; x++)
         for (size_t y = 0; y < 16; y++)
             checkerboardData[y * 16 + x] = ((x % 2) ^ (y % 2)) ? magenta : black;
-    textures.emplace_back(CreateUploadImage(checkerboardData.data(), vk::Format::eR8G8B8A8Unorm, vk::Extent2D{ 16, 16 }, vk::ImageUsageFlagBits::eSampled));
-    textures.emplace_back(CreateUploadImage(&black, vk::Format::eR8G8B8A8Unorm, vk::Extent2D{ 1, 1 }, vk::ImageUsageFlagBits::eSampled));
-    textures.emplace_back(CreateUploadImage(&white, vk::Format::eR8G8B8A8Unorm, vk::Extent2D{ 1, 1 }, vk::ImageUsageFlagBits::eSampled));
-    materialIndexGroups.emplace_back(0, 1, 1);
+    // Slots 0, 1 and 2, the table is still empty.
+    AddTexture(CreateUploadImage(SingleLevelTexture(checkerboardData.data(), sizeof(checkerboardData), vk::Format::eR8G8B8A8Unorm, 16, 16), vk::ImageUsageFlagBits::eSampled));
+    AddTexture(CreateUploadImage(SingleLevelTexture(&black, sizeof(black), vk::Format::eR8G8B8A8Unorm, 1, 1), vk::ImageUsageFlagBits::eSampled));
+    AddTexture(CreateUploadImage(SingleLevelTexture(&white, sizeof(white), vk::Format::eR8G8B8A8Unorm, 1, 1), vk::ImageUsageFlagBits::eSampled));
+    // Fallback material, checkerboard diffuse and no metal, roughness or emission.
+    materials.emplace_back(0, 1, 1, MATERIAL_HAS_DIFFUSE, white, 0.0f, 0.0f, black);
 }
 
 // Temporary functions.
-void Renderer::PushConstant_Draw() {
+void Renderer::FrameConstants_Draw() {
+    PROFILE_ZONE("Frame constants");
     BuildGlobalTransform();
-    SceneInfo sceneInfo;
-    sceneInfo.pointLightCount     = pointLights.size();
-    sceneInfo.spotLightCount      = spotLights.size();
-    sceneInfo.directionLightCount = dirLights.size();
-    sceneInfo.meshCount           = meshViews.size();
-
-    PushConstantData pushConstant{
+    sceneInfo.renderFlags = forceTextureSampling ? RENDER_FORCE_TEXTURE_SAMPLING : 0;
+    sceneInfo.frameNumber = static_cast<uint32_t>(frameNumber);
+    FrameConstants constants{
         vertexTransform,
         worldTransform,
         sceneInfo,
 
-        meshletsAddress,
-        meshletVerticesAddress,
-        meshletTrianglesAddress,
-
-        meshViewBufferAddress,
-        meshBuffer.bufferAddress,
-        materialBufferAddress,
-
-        pointLightBufferAddress,
-        spotLightBufferAddress,
-        dirLightBufferAddress
+        sceneAddressBuffer.bufferAddress,
+        frames[currentFrame].feedbackBuffer.bufferAddress
     };
-    cmdBuffers[currentFrame].bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, imageDescSet, nullptr);
-    cmdBuffers[currentFrame].pushConstants(pipelineLayout, vk::ShaderStageFlagBits::eTaskEXT | vk::ShaderStageFlagBits::eMeshEXT | vk::ShaderStageFlagBits::eFragment, 0, sizeof(PushConstantData), &pushConstant);
+    // The frame that last used this slot has finished, so it can be overwritten.
+    const size_t offset = currentFrame * frameConstantStride;
+    std::memcpy(static_cast<char*>(frameConstantRing.buffer.info.pMappedData) + offset, &constants, sizeof(FrameConstants));
+    vmaFlushAllocation(allocator, frameConstantRing.buffer.alloc, offset, sizeof(FrameConstants));
 }
 void Renderer::ImGui_Draw(double frameTime) {
+    PROFILE_ZONE("Build ImGui");
     ImGui_ImplVulkan_NewFrame();
     ImGui_ImplSDL3_NewFrame();
     ImGui::NewFrame();
@@ -811,34 +1469,103 @@ void Renderer::ImGui_Draw(double frameTime) {
     std::string frameTimeStr = std::to_string(frameTime) + " ms | " + std::to_string(1000 / frameTime) + " fps\n";
     ImGui::Text(positionStr.c_str());
     ImGui::Text(frameTimeStr.c_str());
-    requestNewSwapchain = ImGui::Checkbox("Toggle Vsync", &doVsync);
-    if (requestNewSwapchain)
-        std::cout << "Checkbox pressed!\n";
+    // A CPU that keeps waiting on its fences is GPU bound, more frames in flight only add latency then.
+    ImGui::Text("%zu frames in flight, %zu swapchain images, %.2f ms waited on the GPU", frames.size(), swapchain.images.size(), fenceWaitTime);
+    ImGui::Text("GPU frame: %.3f ms", gpuProfiler.GetFrameTime());
+    // Passes of the last finished frame, a frame in flight behind this one.
+    if (ImGui::BeginTable("GPU passes", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_SizingFixedFit)) {
+        for (const char* header : { "Pass", "ms", "Task", "Mesh", "Fragment" })
+            ImGui::TableSetupColumn(header);
+        ImGui::TableHeadersRow();
+        for (const auto& pass : gpuProfiler.GetResults()) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(pass.name.c_str());
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", pass.time);
+            ImGui::TableNextColumn();
+            ImGui::Text("%llu", static_cast<unsigned long long>(pass.taskInvocations));
+            ImGui::TableNextColumn();
+            ImGui::Text("%llu", static_cast<unsigned long long>(pass.meshInvocations));
+            ImGui::TableNextColumn();
+            ImGui::Text("%llu", static_cast<unsigned long long>(pass.fragmentInvocations));
+        }
+        ImGui::EndTable();
+    }
+    ImGui::Text("Deletions: %zu pending, %u released this frame", deletionQueue.GetPendingCount(), releasedDeletions);
+    ImGui::Text("Input to submit: %.2f ms, oldest event to submit: %.2f ms%s", inputToSubmitTime.load(), eventToSubmitTime.load(), submitThread.joinable() ? " on the submission thread" : "");
+    ImGui::Checkbox(device.supportsPresentWait ? "Low latency (present wait)" : "Low latency", &settings.lowLatency);
+    ImGui::Text("Scene recorded on %u workers in %.3f ms", jobSystem.GetWorkerCount(), recordTime);
+    const auto utilization = jobSystem.GetUtilization();
+    std::string utilizationStr = "Workers busy:";
+    for (float u : utilization)
+        utilizationStr += " " + std::to_string(static_cast<int>(u * 100)) + "%";
+    ImGui::Text(utilizationStr.c_str());
+    if (ImGui::Button("Benchmark recording"))
+        runRecordBenchmark = true;
+    for (const auto& [threads, ms] : recordBenchmarkResults)
+        ImGui::Text("  %u threads: %.3f ms for %u passes", threads, ms, RECORD_BENCHMARK_PASSES);
+    ImGui::Text("Material switches: %u (%.3f per workgroup)", materialSwitches,
+        static_cast<float>(materialSwitches) / std::max<uint32_t>(1, (meshletCount + TASK_GROUP_MESHLETS - 1) / TASK_GROUP_MESHLETS));
+    // Compare frame times with vsync off, untextured channels then cost a sample each again.
+    ImGui::Checkbox("Sample default textures", &forceTextureSampling);
+    ImGui::Text("Textures: %.1f / %.1f MB resident, %u requests pending, %u loads, %u evictions",
+        textureStreamer.GetResidentBytes() / 1048576.0, textureStreamer.GetBudget() / 1048576.0,
+        textureStreamer.GetPendingRequests(), textureStreamer.GetLoadCount(), textureStreamer.GetEvictionCount());
+    if (ImGui::BeginCombo("Present mode", vk::to_string(swapchain.presentMode).c_str())) {
+        for (auto mode : swapchain.supportedPresentModes)
+            if (ImGui::Selectable(vk::to_string(mode).c_str(), mode == swapchain.presentMode)) {
+                settings.presentMode = mode;
+                requestNewSwapchain  = true;
+            }
+        ImGui::EndCombo();
+    }
+    float frameRateLimit = static_cast<float>(settings.frameRateLimit);
+    if (ImGui::SliderFloat("FPS limit (0 = off)", &frameRateLimit, 0, 500, "%.0f"))
+        settings.frameRateLimit = frameRateLimit;
+    ImGui::Text("Limiter waited %.2f ms", frameLimiter.GetWaitTime());
+    bool profileCpu = Profiler::IsEnabled();
+    if (ImGui::Checkbox("CPU profiler", &profileCpu))
+        Profiler::SetEnabled(profileCpu);
+    ImGui::SameLine();
+    if (ImGui::Button("Save CPU trace")) {
+        if (Profiler::WriteChromeTrace("cpu_trace.json"))
+            std::cout << "Wrote CPU trace to cpu_trace.json\n";
+        else
+            std::cout << "Could not write cpu_trace.json\n";
+    }
 }
 void Renderer::LoadModels_Init() {
+    PROFILE_ZONE("Load models");
     parser = fastgltf::Parser(fastgltf::Extensions::KHR_lights_punctual);
 
+    struct Model {
+        std::filesystem::path path;
+        glm::mat4 transform;
+    };
+    std::vector<Model> models;
+
     auto dragonTrans = glm::mat4(1.0f);
     dragonTrans = glm::translate(dragonTrans, glm::vec3(5.0f, 5.0f, 2.0f));
     dragonTrans = glm::rotate<float>(dragonTrans, glm::radians(180.0f), glm::vec3(-1, 0, 0));
     dragonTrans = glm::scale(dragonTrans, glm::vec3(0.1f));
-    LoadGLTF("assets/stanford_dragon.glb", dragonTrans);
+    models.emplace_back("assets/stanford_dragon.glb", dragonTrans);
 
     auto helmetTrans = glm::mat4(1.0f);
     helmetTrans = glm::translate(helmetTrans, glm::vec3(-5.0f, 0, 0));
     helmetTrans = glm::rotate<float>(helmetTrans, glm::radians(90.0f), glm::vec3(-1, 0, 0));
-    LoadGLTF("assets/DamagedHelmet.glb", helmetTrans);
+    models.emplace_back("assets/DamagedHelmet.glb", helmetTrans);
 
     auto toyTrans = glm::mat4(1.0f);
     toyTrans = glm::translate(toyTrans, glm::vec3(-3.0f, 0, 0));
     toyTrans = glm::rotate<float>(toyTrans, glm::radians(90.0f), glm::vec3(-1, 0, 0));
     toyTrans = glm::scale(toyTrans, glm::vec3(0.005f));
-    LoadGLTF("assets/ToyCar.glb", toyTrans);
+    models.emplace_back("assets/ToyCar.glb", toyTrans);
 
     auto monkeTrans = glm::mat4(1.0f);
     monkeTrans = glm::translate(monkeTrans, glm::vec3(-2, -4, 3));
     monkeTrans = glm::rotate(monkeTrans, glm::radians(180.0f), glm::vec3(-1, 0, 0));
-    LoadGLTF("assets/monke.glb", monkeTrans);
+    models.emplace_back("assets/monke.glb", monkeTrans);
 
     // Many sponzas for benchmarking.
     //for (size_t i = 0; i < 2; i++) {
@@ -848,14 +1575,114 @@ void Renderer::LoadModels_Init() {
     //            sponzaTrans = glm::translate(sponzaTrans, glm::vec3(i * 40, j * 20, k * 25));
     //            sponzaTrans = glm::rotate<float>(sponzaTrans, glm::radians(180.0f), glm::vec3(-1, 0, 0));
     //            sponzaTrans = glm::scale(sponzaTrans, glm::vec3(0.01f));
-    //            LoadGLTF("assets/sponza.glb", sponzaTrans);
+    //            models.emplace_back("assets/sponza.glb", sponzaTrans);
     //        }
     //    }
     //}
+
+    // The cache only holds GPU ready streams, CPU copies have to come from the models.
+    if (settings.sceneResidency == SceneResidency::eRetain)
+        settings.useSceneCache = false;
+
+    // The cache is keyed by the models, their transforms and the state of their files.
+    uint64_t cacheKey = 14695981039346656037ull;
+    for (const auto& m : models) {
+        std::error_code error;
+        const auto pathStr   = m.path.generic_string();
+        const auto fileSize  = std::filesystem::file_size(m.path, error);
+        const auto writeTime = std::filesystem::last_write_time(m.path, error).time_since_epoch().count();
+        cacheKey = HashBytes(cacheKey, pathStr.data(), pathStr.size());
+        cacheKey = HashBytes(cacheKey, &fileSize, sizeof(fileSize));
+        cacheKey = HashBytes(cacheKey, &writeTime, sizeof(writeTime));
+        cacheKey = HashBytes(cacheKey, &m.transform, sizeof(m.transform));
+    }
+    sceneCache    = SceneCache("cache/scene.bin", cacheKey);
+    sceneCacheHit = settings.useSceneCache && sceneCache.Load();
+    if (sceneCacheHit)
+        std::cout << "Found scene cache, skipping geometry processing.\n";
+
+    for (const auto& m : models)
+        LoadGLTF(m.path, m.transform, !sceneCacheHit);
+
     std::cout << "\nLoaded all models.\n";
     std::cout << "Size of all vertices: " << sizeof(Vertex) * vertices.size() << " Bytes, indices: " << sizeof(glm::uvec4) * indices.size() << " Bytes\n";
 }
+template<typename T>
+void ReleaseVector(std::vector<T>& vector) {
+    std::vector<T>().swap(vector);
+}
+void Renderer::LoadTextures_Init() {
+    PROFILE_ZONE("Load textures");
+    Timer timer = Timer();
+    const bool compress        = settings.compressTextures && device.supportsTextureCompressionBC;
+
+    // One job per texture decodes, filters and encodes it, the report waits on all of them.
+    std::vector<EncodedTexture> encoded(pendingTextures.size());
+    std::atomic<uint32_t> cacheHits = 0;
+    std::vector<JobHandle> encodeJobs;
+    for (size_t i = 0; i < pendingTextures.size(); i++)
+        encodeJobs.emplace_back(jobSystem.Submit([&, i](uint32_t) {
+            PROFILE_ZONE("Encode texture");
+            const auto& pending = pendingTextures[i];
+            uint64_t key = HashBytes(14695981039346656037ull, pending.file.data(), pending.file.size());
+            key = HashBytes(key, &pending.usage, sizeof(pending.usage));
+            key = HashBytes(key, &compress, sizeof(compress));
+            const auto path = std::filesystem::path("cache/textures") / (std::to_string(key) + ".bin");
+            if (settings.useTextureCache && ReadTextureCache(path, key, encoded[i])) {
+                cacheHits++;
+                return;
+            }
+
+            int width, height, comp;
+            unsigned char* pixels = stbi_load_from_memory(pending.file.data(), pending.file.size(), &width, &height, &comp, STBI_rgb_alpha);
+            if (!pixels)
+                return;
+            encoded[i] = EncodeTexture(pixels, width, height, pending.usage, compress, true, 1);
+            stbi_image_free(pixels);
+            if (settings.useTextureCache)
+                WriteTextureCache(path, key, encoded[i]);
+        }));
+    auto report = jobSystem.Submit([&](uint32_t) {
+        std::cout << "Encoded " << pendingTextures.size() << " textures with mips (" << cacheHits << " from cache) in " << timer.GetMilliseconds()
+            << " ms on " << jobSystem.GetWorkerCount() << " workers" << "\n";
+    }, encodeJobs);
+    jobSystem.Wait(report);
+    timer.Reset();
+
+    // Only the mip tails are uploaded now, finer levels are streamed in once the GPU asks for them.
+    // Uploads go through the immediate command buffers, so they stay on this thread.
+    textureStreamer = TextureStreamer(settings.textureBudget);
+    textureData.resize(textures.size());
+    for (size_t i = 0; i < pendingTextures.size(); i++) {
+        const auto& pending = pendingTextures[i];
+        if (encoded[i].levels.empty()) {
+            std::cout << "Could not decode texture " << pending.slot << ", it is replaced by a white texture.\n";
+            uint32_t white = glm::packUnorm4x8(glm::vec4(1, 1, 1, 1));
+            SetTexture(pending.slot, CreateUploadImage(SingleLevelTexture(&white, sizeof(white), vk::Format::eR8G8B8A8Unorm, 1, 1), vk::ImageUsageFlagBits::eSampled));
+            continue;
+        }
+        uint32_t tailMip = 0;
+        std::vector<uint64_t> levelBytes;
+        for (const auto& level : encoded[i].levels) {
+            if (std::max(level.width, level.height) > STREAM_TAIL_SIZE)
+                tailMip++;
+            levelBytes.emplace_back(level.size);
+        }
+        tailMip = std::min<uint32_t>(tailMip, encoded[i].levels.size() - 1);
+        textureStreamer.AddTexture(pending.slot, std::move(levelBytes), tailMip);
+        SetTexture(pending.slot, CreateUploadImage(encoded[i], vk::ImageUsageFlagBits::eSampled, tailMip));
+
+        auto& memory = textureMemory[static_cast<uint32_t>(pending.usage)];
+        memory.count++;
+        memory.rgbaBytes += static_cast<size_t>(encoded[i].levels[0].width) * encoded[i].levels[0].height * 4;
+        memory.gpuBytes  += encoded[i].data.size();
+        textureData[pending.slot] = std::move(encoded[i]);
+    }
+    ReleaseVector(pendingTextures);
+    std::cout << "Uploaded textures in " << timer.GetMilliseconds() << " ms" << "\n\n";
+}
 void Renderer::SpawnLights_Init() {
+    PROFILE_ZONE("Spawn lights");
     // xyz: 20 0 25 "Centre"
     const auto centre = glm::vec3(20, 0, 25);
     std::random_device randomDevice;
@@ -877,25 +1704,119 @@ void Renderer::SpawnLights_Init() {
     spotLights.emplace_back(glm::vec3(-9.0f, -1.0f, 2.0f), 10.0f, glm::vec4(1.0f, 0.0f, -1.0f, 1), glm::vec3(1), 0.0f, 0.95f, 0.96f);
 }
 void Renderer::UploadAll_Init() {
-    // Upload geometry and material indices.
-    if (indices.size() > 0 && vertices.size() > 0)
-        meshBuffer = UploadMesh(vertices);
+    PROFILE_ZONE("Upload scene");
+    // Upload mesh views and material indices, the vertices are already uploaded by OptimizeMesh.
     if (meshViews.size() > 0)
-        meshViewBufferAddress = UploadData<MeshView>(meshViews);
+        meshViewBuffer = UploadData<MeshView>(meshViews);
 
     // Upload materials.
-    if (materialIndexGroups.size() > 0)
-        materialBufferAddress   = UploadData<MaterialIndexGroup>(materialIndexGroups);
+    if (materials.size() > 0)
+        materialBuffer   = UploadData<Material>(materials);
 
     // Upload lights.
     if (pointLights.size() > 0)
-        pointLightBufferAddress = UploadData<PointLight>(pointLights);
+        pointLightBuffer = UploadData<PointLight>(pointLights);
     if (spotLights.size() > 0)
-        spotLightBufferAddress  = UploadData<SpotLight>(spotLights);
+        spotLightBuffer  = UploadData<SpotLight>(spotLights);
     if (dirLights.size() > 0)
-        dirLightBufferAddress   = UploadData<DirLight>(dirLights);
+        dirLightBuffer   = UploadData<DirLight>(dirLights);
+
+    sceneInfo.pointLightCount     = pointLights.size();
+    sceneInfo.spotLightCount      = spotLights.size();
+    sceneInfo.directionLightCount = dirLights.size();
+    sceneInfo.meshCount           = meshViews.size();
+    sceneInfo.meshletCount        = meshletCount;
+    sceneInfo.renderFlags         = 0;
+    sceneInfo.textureCount        = textureSlots.GetEnd();
+    materialSwitches              = CountMaterialSwitches(meshViews);
+    // One chunk per recording thread, cut at task workgroup boundaries.
+    const uint32_t threadMeshlets = (meshletCount + jobSystem.GetWorkerCount() - 1) / jobSystem.GetWorkerCount();
+    chunkMeshlets = std::max<uint32_t>(TASK_GROUP_MESHLETS, (threadMeshlets + TASK_GROUP_MESHLETS - 1) / TASK_GROUP_MESHLETS * TASK_GROUP_MESHLETS);
+
+    // The scene buffers do not move anymore, so their addresses only need uploading once.
+    SceneAddresses addresses{
+        meshletBuffer.bufferAddress,
+        meshletVertexBuffer.bufferAddress,
+        meshletTriangleBuffer.bufferAddress,
+
+        meshViewBuffer.bufferAddress,
+        meshBuffer.bufferAddress,
+        materialBuffer.bufferAddress,
+
+        pointLightBuffer.bufferAddress,
+        spotLightBuffer.bufferAddress,
+        dirLightBuffer.bufferAddress
+    };
+    sceneAddressBuffer = UploadData<SceneAddresses>(std::span(&addresses, 1));
+}
+void Renderer::ReleaseSceneCopies_Init() {
+    PROFILE_ZONE("Release scene copies");
+    if (settings.sceneResidency == SceneResidency::eRetain)
+        return;
+
+    // Everything below lives in GPU buffers now, only the counts in sceneInfo and meshletCount are still needed.
+    ReleaseVector(vertices);
+    ReleaseVector(indices);
+    ReleaseVector(meshlets);
+    ReleaseVector(meshletVertices);
+    ReleaseVector(meshletTriangles);
+    ReleaseVector(meshViews);
+    ReleaseVector(materials);
+    ReleaseVector(pointLights);
+    ReleaseVector(spotLights);
+    ReleaseVector(dirLights);
+}
+template<typename T>
+size_t VectorBytes(const std::vector<T>& vector) {
+    return vector.capacity() * sizeof(T);
+}
+void Renderer::ReportSceneMemory() {
+    struct MemoryEntry {
+        const char* category;
+        size_t cpuBytes;
+        size_t gpuBytes;
+    };
+    size_t textureBytes = 0;
+    for (const auto& t : textures) {
+        if (!t.alloc)
+            continue;
+        VmaAllocationInfo info;
+        vmaGetAllocationInfo(allocator, t.alloc, &info);
+        textureBytes += info.size;
+    }
+    const std::array<MemoryEntry, 9> entries = { {
+        { "Vertices",          VectorBytes(vertices),            meshBuffer.buffer.info.size },
+        { "Indices",           VectorBytes(indices),             0 },
+        { "Meshlets",          VectorBytes(meshlets),            meshletBuffer.buffer.info.size },
+        { "Meshlet vertices",  VectorBytes(meshletVertices),     meshletVertexBuffer.buffer.info.size },
+        { "Meshlet triangles", VectorBytes(meshletTriangles),    meshletTriangleBuffer.buffer.info.size },
+        { "Mesh views",        VectorBytes(meshViews),           meshViewBuffer.buffer.info.size },
+        { "Materials",         VectorBytes(materials),           materialBuffer.buffer.info.size },
+        { "Lights",            VectorBytes(pointLights) + VectorBytes(spotLights) + VectorBytes(dirLights),
+            pointLightBuffer.buffer.info.size + spotLightBuffer.buffer.info.size + dirLightBuffer.buffer.info.size },
+        { "Textures",          0,                                textureBytes }
+    } };
+
+    size_t cpuTotal = 0, gpuTotal = 0;
+    std::cout << "\nScene memory (" << (settings.sceneResidency == SceneResidency::eRetain ? "CPU copies retained" : "CPU copies released") << "):\n";
+    for (const auto& e : entries) {
+        std::cout << "  " << e.category << ": CPU " << e.cpuBytes << " Bytes, GPU " << e.gpuBytes << " Bytes\n";
+        cpuTotal += e.cpuBytes;
+        gpuTotal += e.gpuBytes;
+    }
+    std::cout << "  Total: CPU " << cpuTotal << " Bytes, GPU " << gpuTotal << " Bytes\n";
+
+    std::cout << "Texture memory when fully resident (" << (settings.compressTextures && device.supportsTextureCompressionBC ? "block compressed" : "uncompressed") << "):\n";
+    for (uint32_t i = 0; i < TEXTURE_USAGE_COUNT; i++) {
+        const auto& memory = textureMemory[i];
+        std::cout << "  " << GetTextureUsageName(static_cast<TextureUsage>(i)) << ": " << memory.count << " textures, " << memory.rgbaBytes
+            << " Bytes as RGBA8 -> " << memory.gpuBytes << " Bytes (" << static_cast<double>(memory.rgbaBytes) / std::max<size_t>(memory.gpuBytes, 1) << "x)\n";
+    }
+    std::cout << "  Streamed textures start with " << textureStreamer.GetResidentBytes() << " Bytes of mip tails resident, budget "
+        << textureStreamer.GetBudget() << " Bytes\n\n";
 }
 void Renderer::CreateSamplers_Init() {
+    PROFILE_ZONE("Create samplers");
     auto nearestSamplerInfo = vk::SamplerCreateInfo()
         .setMagFilter(vk::Filter::eNearest)
         .setMinFilter(vk::Filter::eNearest);
@@ -909,59 +1830,204 @@ void Renderer::CreateSamplers_Init() {
         .setMagFilter(vk::Filter::eLinear)
         .setMinFilter(vk::Filter::eLinear);
 
+    // Trilinear and anisotropic, for every scene texture.
+    auto textureSamplerInfo = vk::SamplerCreateInfo()
+        .setMagFilter(vk::Filter::eLinear)
+        .setMinFilter(vk::Filter::eLinear)
+        .setMipmapMode(vk::SamplerMipmapMode::eLinear)
+        .setAddressModeU(vk::SamplerAddressMode::eRepeat)
+        .setAddressModeV(vk::SamplerAddressMode::eRepeat)
+        .setAddressModeW(vk::SamplerAddressMode::eRepeat)
+        .setAnisotropyEnable(device.supportsSamplerAnisotropy)
+        .setMaxAnisotropy(std::min(16.0f, device.maxSamplerAnisotropy))
+        .setMinLod(0.0f)
+        .setMaxLod(VK_LOD_CLAMP_NONE);
+
     nearestSampler = device.device.createSampler(nearestSamplerInfo);
     linearSampler = device.device.createSampler(linearSamplerInfo);
+    textureSampler = device.device.createSampler(textureSamplerInfo);
 }
 void Renderer::CreateDescSets_Init() {
-    // Set bindings for the push descriptor (textures are on set = 0, binding = 0).
+    PROFILE_ZONE("Create descriptor sets");
+    // One large partially bound table (textures are on set = 0, binding = 0), its size does not depend on the scene.
+    // Slots that no frame in flight samples may be written while the set is pending, so new textures never need a new layout.
+    const uint32_t capacity = std::min(MAX_BINDLESS_TEXTURES, device.maxBindlessTextures);
+    textureSlots = SlotAllocator(capacity);
+    textures.resize(capacity);
+    const vk::DescriptorBindingFlags bindingFlags = vk::DescriptorBindingFlagBits::ePartiallyBound | vk::DescriptorBindingFlagBits::eUpdateAfterBind |
+        vk::DescriptorBindingFlagBits::eUpdateUnusedWhilePending;
+    auto bindingFlagsInfo = vk::DescriptorSetLayoutBindingFlagsCreateInfo()
+        .setBindingFlags(bindingFlags);
     auto layoutBinding = vk::DescriptorSetLayoutBinding()
         .setBinding(0)
         .setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
-        .setDescriptorCount(textures.size())
+        .setDescriptorCount(capacity)
         .setStageFlags(vk::ShaderStageFlagBits::eFragment);
     auto descriptorLayoutInfo = vk::DescriptorSetLayoutCreateInfo()
-        .setBindings(layoutBinding);
+        .setFlags(vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool)
+        .setBindings(layoutBinding)
+        .setPNext(&bindingFlagsInfo);
     imageDescLayout = device.device.createDescriptorSetLayout(descriptorLayoutInfo);
 
-    // Descriptor pool.
+    // Descriptor pool, one set per frame in flight so streaming can swap the view of a slot while the other frame still samples the old one.
+    const uint32_t setCount = frames.size();
     auto imagePoolSize = vk::DescriptorPoolSize()
         .setType(vk::DescriptorType::eCombinedImageSampler)
-        // Change to frames in flight count.
-        .setDescriptorCount(textures.size());
+        .setDescriptorCount(capacity * setCount);
     auto imagePoolInfo = vk::DescriptorPoolCreateInfo()
-        // Change to frames in flight count.
-        .setMaxSets(1)
+        .setFlags(vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind)
+        .setMaxSets(setCount)
         .setPoolSizes(imagePoolSize);
     auto imagePool = device.device.createDescriptorPool(imagePoolInfo);
 
-    // Descriptor set.
+    // Descriptor sets, nothing is written until textures are added.
+    std::vector<vk::DescriptorSetLayout> setLayouts(setCount, imageDescLayout);
     auto imageDescAlloc = vk::DescriptorSetAllocateInfo()
         .setDescriptorPool(imagePool)
-        .setSetLayouts(imageDescLayout);
-    imageDescSet = device.device.allocateDescriptorSets(imageDescAlloc);
-
-    // Write to descriptors.
-    std::vector<vk::DescriptorImageInfo> imageDescriptors;
-    imageDescriptors.reserve(textures.size());
-    for (size_t i = 0; i < textures.size(); i++) {
-        auto imageDescriptor = vk::DescriptorImageInfo()
-            .setSampler(nearestSampler)
-            .setImageLayout(vk::ImageLayout::eAttachmentOptimal)
-            .setImageView(textures[i].view);
-
-        imageDescriptors.emplace_back(imageDescriptor);
+        .setSetLayouts(setLayouts);
+    auto imageDescSets = device.device.allocateDescriptorSets(imageDescAlloc);
+    for (uint32_t i = 0; i < setCount; i++) {
+        frames[i].imageDescSet = imageDescSets[i];
+        frames[i].boundMips.resize(capacity);
+    }
+    std::cout << "Texture table holds " << capacity << " slots\n";
+}
+uint32_t Renderer::AddTexture(AllocatedImage image) {
+    const uint32_t slot = textureSlots.Allocate();
+    if (slot == UINT32_MAX) {
+        std::cout << "Texture table is full.\n";
+        device.device.destroyImageView(image.view);
+        vmaDestroyImage(allocator, image.image, image.alloc);
+        return UINT32_MAX;
+    }
+    SetTexture(slot, image);
+    return slot;
+}
+void Renderer::SetTexture(uint32_t slot, AllocatedImage image) {
+    // No pending frame samples a slot that was just filled, so every set takes it right away.
+    textures[slot] = image;
+    for (auto& frame : frames) {
+        WriteTextureDescriptors(frame.imageDescSet, std::span(&slot, 1));
+        frame.boundMips[slot] = textureStreamer.GetResidentMip(slot);
+    }
+}
+void Renderer::RemoveTexture(uint32_t slot) {
+    deletionQueue.PushImage(NextTimelineValue(), textures[slot].image, textures[slot].view, textures[slot].alloc);
+    deletionQueue.PushCallback(NextTimelineValue(), [this, slot]() { textureSlots.Free(slot); });
+    textures[slot] = AllocatedImage();
+    if (slot < textureData.size())
+        textureData[slot] = EncodedTexture();
+    textureStreamer.RemoveTexture(slot);
+    for (auto& frame : frames)
+        std::erase(frame.dirtyTextureSlots, slot);
+}
+void Renderer::WriteTextureDescriptors(vk::DescriptorSet set, std::span<const uint32_t> slots) {
+    std::vector<vk::DescriptorImageInfo> imageDescriptors(slots.size());
+    std::vector<vk::WriteDescriptorSet> descWrites(slots.size());
+    for (size_t i = 0; i < slots.size(); i++) {
+        imageDescriptors[i] = vk::DescriptorImageInfo()
+            .setSampler(textureSampler)
+            .setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+            .setImageView(textures[slots[i]].view);
+        descWrites[i] = vk::WriteDescriptorSet()
+            .setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
+            .setDstSet(set)
+            .setDstBinding(0)
+            .setDstArrayElement(slots[i])
+            .setDescriptorCount(1)
+            .setPImageInfo(&imageDescriptors[i]);
+    }
+    if (!descWrites.empty())
+        device.device.updateDescriptorSets(descWrites, nullptr);
+}
+void Renderer::CreateFeedbackBuffers_Init() {
+    PROFILE_ZONE("Create feedback buffers");
+    // Host visible, so the CPU reads a frame's requests right after its fence without a copy.
+    for (auto& frame : frames) {
+        auto& feedback = frame.feedbackBuffer;
+        feedback.buffer = CreateBuffer(textureSlots.GetCapacity() * sizeof(uint32_t), vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress,
+            VMA_MEMORY_USAGE_GPU_TO_CPU);
+        std::memset(feedback.buffer.info.pMappedData, 0xFF, textureSlots.GetCapacity() * sizeof(uint32_t));
+        vmaFlushAllocation(allocator, feedback.buffer.alloc, 0, VK_WHOLE_SIZE);
+
+        auto addressInfo = vk::BufferDeviceAddressInfo()
+            .setBuffer(feedback.buffer.buffer);
+        feedback.bufferAddress = device.device.getBufferAddress(addressInfo);
+    }
+}
+void Renderer::CreateFrameConstants_Init() {
+    PROFILE_ZONE("Create frame constants");
+    frameConstantStride = (sizeof(FrameConstants) + FRAME_CONSTANTS_ALIGNMENT - 1) / FRAME_CONSTANTS_ALIGNMENT * FRAME_CONSTANTS_ALIGNMENT;
+    frameConstantRing.buffer = CreateBuffer(frameConstantStride * frames.size(), vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress,
+        VMA_MEMORY_USAGE_CPU_TO_GPU);
+    auto addressInfo = vk::BufferDeviceAddressInfo()
+        .setBuffer(frameConstantRing.buffer.buffer);
+    frameConstantRing.bufferAddress = device.device.getBufferAddress(addressInfo);
+}
+void Renderer::CreateGpuProfiler_Init() {
+    gpuProfiler = GpuProfiler(device.device, device.physicalDevice, device.graphicsQueueFamilyIndex, frames.size(), device.supportsPipelineStatistics);
+}
+void Renderer::CollectFrameReport(uint32_t frameIndex) {
+    auto& frame = frames[frameIndex];
+    if (frame.reportFrame == UINT64_MAX || !IsComplete(frame.timelineValue))
+        return;
+    // The frame finished, so its queries are available without waiting.
+    gpuProfiler.Resolve(frameIndex);
+    const uint64_t reportFrame = frame.reportFrame;
+    frame.reportFrame = UINT64_MAX;
+    if (!settings.reportFrames)
+        return;
+    frameReports.emplace_back(
+        reportFrame,
+        gpuProfiler.GetFrameTime(),
+        meshletCount,
+        sceneInfo.pointLightCount + sceneInfo.spotLightCount + sceneInfo.directionLightCount,
+        gpuProfiler.GetResults());
+}
+void Renderer::ReleaseRetired_Draw() {
+    PROFILE_ZONE("Release retired");
+    // Everything whose last submit finished on the GPU is unused now.
+    releasedDeletions = deletionQueue.Flush(GetCompletedTimelineValue());
+}
+void Renderer::StreamTextures_Draw() {
+    PROFILE_ZONE("Stream textures");
+    // The frame that last used this slot has finished, so its feedback is complete.
+    auto& frame = frames[currentFrame];
+    auto& feedback = frame.feedbackBuffer;
+    vmaInvalidateAllocation(allocator, feedback.buffer.alloc, 0, VK_WHOLE_SIZE);
+    auto* requestedLods = static_cast<uint32_t*>(feedback.buffer.info.pMappedData);
+    // Nothing past the highest slot handed out is bound, so nothing there was sampled.
+    const uint32_t slotEnd = textureSlots.GetEnd();
+    std::vector<uint32_t> requestedMips(slotEnd, UINT32_MAX);
+    for (uint32_t slot = 0; slot < slotEnd; slot++) {
+        if (requestedLods[slot] == UINT32_MAX)
+            continue;
+        // Relative to the view that frame sampled, which starts at its resident mip.
+        const int64_t mip = static_cast<int64_t>(frame.boundMips[slot]) + requestedLods[slot] - FEEDBACK_LOD_BIAS;
+        requestedMips[slot] = static_cast<uint32_t>(std::max<int64_t>(mip, 0));
+    }
+    std::memset(requestedLods, 0xFF, slotEnd * sizeof(uint32_t));
+    vmaFlushAllocation(allocator, feedback.buffer.alloc, 0, VK_WHOLE_SIZE);
+    textureStreamer.ProcessFeedback(requestedMips, frameNumber);
+
+    // Changed textures get a new image holding their resident levels, the old one is retired.
+    for (const auto& change : textureStreamer.Update(frameNumber, settings.textureUploadBytesPerFrame)) {
+        AllocatedBuffer staging;
+        auto image = RecordTextureUpload(textureData[change.slot], vk::ImageUsageFlagBits::eSampled, change.residentMip, staging, frame.cmdBuffer);
+        const auto& old = textures[change.slot];
+        deletionQueue.PushImage(NextTimelineValue(), old.image, old.view, old.alloc);
+        deletionQueue.PushBuffer(NextTimelineValue(), staging.buffer, staging.alloc);
+        textures[change.slot] = image;
+        for (auto& other : frames)
+            other.dirtyTextureSlots.emplace_back(change.slot);
     }
-    auto descWrite = vk::WriteDescriptorSet()
-        .setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
-        .setDstSet(imageDescSet[0])
-        .setDstBinding(0)
-        .setDescriptorCount(imageDescriptors.size())
-        .setImageInfo(imageDescriptors);
-    std::array<vk::WriteDescriptorSet, 1> descWrites{
-        descWrite
-    };
 
-    std::function<void()> descFunc = [&]() { device.device.updateDescriptorSets(descWrites, nullptr); };
-    SubmitImmediate(descFunc);
-    device.device.resetCommandPool(command.cmdPool);
-}
\ No newline at end of file
+    // This frame's descriptor set is not in use anymore, so it can take every view that changed since it was last bound.
+    auto& dirty = frame.dirtyTextureSlots;
+    std::sort(dirty.begin(), dirty.end());
+    dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
+    WriteTextureDescriptors(frame.imageDescSet, dirty);
+    for (uint32_t slot : dirty)
+        frame.boundMips[slot] = textureStreamer.GetResidentMip(slot);
+    dirty.clear();
+}
@@ -5,6 +5,16 @@
 #include "Instance.h"
 #include "Command.h"
 #include "Timer.h"
+#include "SceneCache.h"
+#include "TextureCompression.h"
+#include "TextureStreamer.h"
+#include "SlotAllocator.h"
+#include "DeletionQueue.h"
+#include "JobSystem.h"
+#include "SpscQueue.h"
+#include "FrameLimiter.h"
+#include "GpuProfiler.h"
+#include "Profiler.h"
 
 #include "stb_image.h"
 
@@ -22,15 +32,20 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_ptr.hpp>
 
 #include <fastgltf/core.hpp>
 #include <fastgltf/tools.hpp>
 
 #include <meshoptimizer.h>
 
+#include <algorithm>
+#include <cfloat>
 #include <iostream>
+#include <numeric>
 #include <vector>
 #include <random>
+#include <thread>
 
 struct Vertex {
 	glm::vec3 Position;
@@ -38,11 +53,22 @@ struct Vertex {
 	glm::vec3 Normal;
 	float V;
 };
-struct MaterialIndexGroup {
+// Texture indices are only valid when their bit in flags is set, otherwise the factor alone is used.
+struct Material {
 	uint32_t diffuse;
 	uint32_t metallicRoughness;
 	uint32_t emissive;
+	uint32_t flags;
+	// packUnorm4x8 of the RGBA base color factor.
+	uint32_t baseColorFactor;
+	float metallicFactor;
+	float roughnessFactor;
+	// packUnorm4x8 of the RGB emissive factor.
+	uint32_t emissiveFactor;
 };
+constexpr uint32_t MATERIAL_HAS_DIFFUSE            = 1 << 0;
+constexpr uint32_t MATERIAL_HAS_METALLIC_ROUGHNESS = 1 << 1;
+constexpr uint32_t MATERIAL_HAS_EMISSIVE           = 1 << 2;
 struct PointLight {
 	glm::vec3 Position;
 	float radius;
@@ -64,23 +90,42 @@ struct SpotLight {
 	float fillerA;
 	float fillerB;
 };
+// Meshlet as read by the shaders, see Meshlet in shaders/common.h.
+struct PackedMeshlet {
+	uint32_t vertexBase;
+	// In 16-bit entries of the packed meshlet vertex buffer.
+	uint32_t vertexOffset;
+	uint32_t triangleOffset;
+	// Vertex count in bits 0-7, triangle count in bits 8-15, MESHLET_WIDE_VERTICES and the material from MESHLET_MATERIAL_SHIFT on.
+	uint32_t counts;
+};
+// Set when a meshlet spans more than 16 bits of vertices, its references are then stored as absolute 32-bit indices split into two halves.
+constexpr uint32_t MESHLET_WIDE_VERTICES = 1 << 16;
+constexpr uint32_t MESHLET_MATERIAL_SHIFT = 17;
+// Materials the bits above MESHLET_MATERIAL_SHIFT can address.
+constexpr size_t MAX_MATERIALS = size_t(1) << (32 - MESHLET_MATERIAL_SHIFT);
+// Meshlets a task workgroup is expected to cover once culling moves into the task shader.
+constexpr size_t TASK_GROUP_MESHLETS = 32;
 struct MeshView {
 	uint32_t start;
 	uint32_t end;
 	uint32_t material;
-	uint32_t filler;
+	uint32_t meshletCount;
 };
 struct SceneInfo {
 	uint32_t meshCount;
 	uint32_t pointLightCount;
 	uint32_t spotLightCount;
 	uint32_t directionLightCount;
+	uint32_t meshletCount;
+	uint32_t renderFlags;
+	uint32_t frameNumber;
+	uint32_t textureCount;
 };
-struct PushConstantData {
-	glm::mat4 projView;
-	glm::mat4 worldTransform;
-	SceneInfo sceneInfo;
-
+// Sample the default textures for untextured channels like before, to compare against the factor only path.
+constexpr uint32_t RENDER_FORCE_TEXTURE_SAMPLING = 1 << 0;
+// Device addresses of the scene buffers, uploaded once after the scene is and read through FrameConstants.
+struct SceneAddresses {
 	vk::DeviceAddress meshletsAddress;
 	vk::DeviceAddress meshletVerticesAddress;
 	vk::DeviceAddress meshletTrianglesAddress;
@@ -93,10 +138,36 @@ struct PushConstantData {
 	vk::DeviceAddress spotLightBufferAddress;
 	vk::DeviceAddress dirLightBufferAddress;
 };
+// Everything that changes per frame, written into this frame's slot of the constants ring.
+// New per-view data goes here, the push constant stays a single address.
+struct FrameConstants {
+	glm::mat4 projView;
+	glm::mat4 worldTransform;
+	SceneInfo sceneInfo;
+
+	vk::DeviceAddress sceneAddressesAddress;
+	vk::DeviceAddress feedbackBufferAddress;
+};
+// Slots of the constants ring are aligned to this, enough for any minUniformBufferOffsetAlignment.
+constexpr size_t FRAME_CONSTANTS_ALIGNMENT = 256;
+struct PushConstantData {
+	vk::DeviceAddress frameConstantsAddress;
+	// First meshlet of the chunk a secondary command buffer draws.
+	uint32_t meshletOffset;
+	uint32_t padding;
+};
+// Synthetic passes in the recording benchmark, each records the whole scene again.
+constexpr uint32_t RECORD_BENCHMARK_PASSES = 64;
+// Texture feedback holds the requested level relative to the bound view plus this bias, so finer requests stay positive.
+constexpr uint32_t FEEDBACK_LOD_BIAS = 16;
+// Levels up to this size are always resident, finer ones are streamed in on request.
+constexpr uint32_t STREAM_TAIL_SIZE = 128;
+// Upper bound of the bindless texture table, the device limit may lower it.
+constexpr uint32_t MAX_BINDLESS_TEXTURES = 16384;
 struct AllocatedBuffer {
 	vk::Buffer buffer;
-	VmaAllocation alloc;
-	VmaAllocationInfo info;
+	VmaAllocation alloc = nullptr;
+	VmaAllocationInfo info = {};
 };
 struct AllocatedImage {
 	vk::Image image;
@@ -105,7 +176,112 @@ struct AllocatedImage {
 };
 struct GPUBuffer {
 	AllocatedBuffer buffer;
-	vk::DeviceAddress bufferAddress;
+	vk::DeviceAddress bufferAddress = 0;
+};
+// Destination of an upload, pMapped points either straight into the GPU buffer (ReBAR/UMA) or into a staging buffer.
+struct UploadTarget {
+	AllocatedBuffer buffer;
+	AllocatedBuffer staging;
+	std::byte* pMapped;
+	size_t size;
+	bool isDirect;
+};
+// What happens to the CPU side copies of the scene once they are uploaded.
+enum class SceneResidency {
+	// Free them, the GPU buffers are the only copy.
+	eRelease,
+	// Keep them for CPU side culling and picking.
+	eRetain
+};
+struct RendererSettings {
+	SceneResidency sceneResidency = SceneResidency::eRelease;
+	// Load processed geometry from the compressed scene cache, only used with SceneResidency::eRelease.
+	bool useSceneCache = true;
+	// Print decode throughput of the scene cache against a raw copy when it is loaded.
+	bool benchmarkSceneCache = false;
+	// Store textures block compressed when the GPU supports BC formats, otherwise as RG8 and sRGB RGBA8.
+	bool compressTextures = true;
+	// Reuse encoded textures and their mips from cache/textures, keyed by the image file contents.
+	bool useTextureCache = true;
+	// VRAM streamed textures may take, their mip tails always stay resident even when they exceed it.
+	size_t textureBudget = 256ull << 20;
+	// Texture bytes uploaded per frame at most, evictions included. A streamed in texture is uploaded whole, so it settles for the finest level whose chain fits.
+	size_t textureUploadBytesPerFrame = 32ull << 20;
+	// Frames the CPU may record ahead of the GPU (1-4), more hides stalls at the cost of latency.
+	uint32_t framesInFlight = 2;
+	// Swapchain images asked for, independent of framesInFlight and clamped to what the surface allows.
+	uint32_t swapchainImageCount = 2;
+	// Submit and present finished frames on their own thread, so a blocking present does not hold up recording the next frame.
+	bool submitThread = true;
+	// Wait for the previous frame to finish, or to be displayed with present wait, then read input and build the camera right before submit.
+	bool lowLatency = false;
+	// Mailbox renders uncapped without tearing, FIFO relaxed tears only on late frames. Unsupported modes fall back to FIFO.
+	vk::PresentModeKHR presentMode = vk::PresentModeKHR::eFifo;
+	// Frames per second the CPU is held to, 0 for no limit.
+	double frameRateLimit = 0;
+	// Render into offscreen images without a window, surface or swapchain, for benchmarks on machines without a display.
+	bool headless = false;
+	vk::Extent2D headlessExtent = { 1280, 720 };
+	// Keep a FrameReport of every finished frame until TakeFrameReports collects them.
+	bool reportFrames = false;
+};
+// Longest a low latency frame waits for the previous one to be displayed.
+constexpr uint64_t PRESENT_WAIT_TIMEOUT = 100'000'000;
+// Longest an acquire blocks at once, the spec forbids an infinite one when too few images may be free.
+constexpr uint64_t ACQUIRE_TIMEOUT = 100'000'000;
+constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 4;
+// Texture memory of one usage, next to what the same textures would take as RGBA8.
+struct TextureMemory {
+	uint32_t count = 0;
+	size_t rgbaBytes = 0;
+	size_t gpuBytes  = 0;
+};
+// Image file of a texture slot, decoded and encoded once all models are loaded.
+struct PendingTexture {
+	std::vector<unsigned char> file;
+	TextureUsage usage;
+	uint32_t slot;
+};
+// Everything one frame in flight records into or reads back, reused once its fence signalled.
+struct FrameResources {
+	vk::CommandBuffer cmdBuffer;
+	vk::Semaphore imageAquiredSemaphore;
+	// Timeline value the last submit of this frame signals.
+	uint64_t timelineValue = 0;
+	AllocatedImage depthImage;
+
+	vk::DescriptorSet imageDescSet;
+	GPUBuffer feedbackBuffer;
+	// Resident mip the descriptor set was written with, and the slots it still has to rewrite.
+	std::vector<uint32_t> boundMips;
+	std::vector<uint32_t> dirtyTextureSlots;
+	// Frame number recorded into these resources and not reported yet, UINT64_MAX when there is none.
+	uint64_t reportFrame = UINT64_MAX;
+};
+// What the GPU did for one frame, available once the frame finished.
+struct FrameReport {
+	uint64_t frame;
+	// Between the first and last pass of the frame, 0 when the graphics queue has no timestamps.
+	double gpuTime;
+	uint32_t meshlets;
+	// Lights every shaded fragment evaluates, nothing culls them yet.
+	uint32_t lights;
+	std::vector<GpuPassResult> passes;
+};
+// Finished frame handed to the submission thread, it only touches the handles in here.
+struct FramePacket {
+	vk::CommandBuffer cmdBuffer;
+	vk::Semaphore imageAquiredSemaphore;
+	vk::Semaphore renderFinishedSemaphore;
+	vk::SwapchainKHR swapchain;
+	// UINT32_MAX when no image was acquired, the frame is then only submitted.
+	uint32_t imageIndex;
+	uint64_t timelineValue;
+	// 0 without present wait support.
+	uint64_t presentId;
+	// When the input the frame was recorded with was read, and the SDL timestamp of its oldest event, 0 without events.
+	std::chrono::steady_clock::time_point inputTime;
+	uint64_t eventTime;
 };
 struct Chunk {
 	uint32_t blocks[32][32];
@@ -116,83 +292,175 @@ struct Chunk {
 class Renderer
 {
 public:
-	Renderer(SDL_Window* window, std::atomic<bool>* ready);
+	// The job system is owned by the application, every worker records and loads for the renderer.
+	Renderer(SDL_Window* window, std::atomic<bool>* ready, JobSystem& jobSystem, RendererSettings settings = {});
+	~Renderer();
 	void Draw();
+	// Reads input for a frame, called by Draw as late as the latency mode allows.
+	// Returns the SDL timestamp of the oldest input event it handled, 0 if there was none.
+	void SetInputLatch(std::function<uint64_t()> latch);
+	std::string GetDeviceName();
+	// Extent frames are currently rendered at, the window size unless running headless.
+	vk::Extent2D GetRenderExtent();
+	// Number of the frame the next Draw records.
+	uint64_t GetFrameNumber();
+	// Time the last Draw spent waiting on the frame limiter and the GPU rather than working.
+	double GetWaitTime();
+	// Reports of the frames finished since the last call, oldest first, only kept with RendererSettings::reportFrames.
+	std::vector<FrameReport> TakeFrameReports();
+	// Waits until every frame handed out so far finished, so their reports can be taken.
+	void Flush();
 
 	void Move(float forward, float sideward);
 	void Teleport(glm::vec3 pos, glm::vec3 direction = glm::vec3(0, 0, 1));
+	void SetCamera(glm::vec3 pos, float yaw, float pitch);
 	float yaw = 0;
 	float pitch = 0;
 private:
 	// Temporary abstractions.
-	void PushConstant_Draw();
+	// Waits until the current frame may be recorded again.
+	void BeginFrame();
+	void LatchInput();
+	// Writes this frame's slot of the constants ring.
+	void FrameConstants_Draw();
+	void StreamTextures_Draw();
+	// Records the scene in meshlet chunks into secondary command buffers on the job system, in order in sceneCommands.
+	void RecordScene_Draw();
+	void ImGuiPass_Draw(const uint32_t imageIndex);
+	// Secondary command buffer of a recording thread, ready to draw inside the scene pass.
+	vk::CommandBuffer BeginSecondary(uint32_t thread);
+	void RecordMeshletChunk(vk::CommandBuffer& cmd, uint32_t firstMeshlet, uint32_t meshletCount);
+	// Records RECORD_BENCHMARK_PASSES copies of the scene pass on 1 to all recording threads without submitting them.
+	void BenchmarkRecording();
 	void ImGui_Draw(double frameTime);
 	void LoadModels_Init();
+	void LoadTextures_Init();
 	void SpawnLights_Init();
 	void UploadAll_Init();
+	void ReleaseSceneCopies_Init();
+	void ReportSceneMemory();
 	void CreateSamplers_Init();
 	void CreateDescSets_Init();
+	void CreateFeedbackBuffers_Init();
+	void CreateFrameConstants_Init();
+	void CreateGpuProfiler_Init();
+	// Reads back the finished frame in the slot and keeps its report.
+	void CollectFrameReport(uint32_t frameIndex);
 	void OptimizeMesh();
+	void UploadMeshlets(std::span<const uint32_t> meshletMaterials);
+	void LoadSceneCache_Init();
 
+	// Ends the frame and submits it, on the submission thread when there is one.
 	void SubmitAndPresent(uint32_t imageIndex);
-	void SubmitImmediate(const std::function<void()>& func);
+	void SubmitFrame(const FramePacket& packet);
+	void SubmitLoop();
+	// Returns once the submission thread submitted and presented everything handed to it.
+	void WaitSubmitIdle();
+	// Records func into a one time command buffer and submits it without waiting, returns the timeline value that signals its completion.
+	uint64_t SubmitImmediate(const std::function<void(vk::CommandBuffer&)>& func);
 	void BeginRendering(const uint32_t imageIndex);
 	bool AquireImageIndex(uint32_t& index);
-	bool doVsync = true;
-	bool requestNewSwapchain = false;
+	// Swaps in a swapchain for the current window size and present mode, old images and size dependent targets are retired, not waited on.
+	void RecreateSwapchain();
+	void ReleaseRetired_Draw();
+	std::atomic<bool> requestNewSwapchain = false;
+	// Replaced swapchains, destroyed once the first frame presented to their successor completed.
+	std::vector<RetiredSwapchain> retiredSwapchains;
+	bool forceTextureSampling = false;
+	bool runRecordBenchmark = false;
 
 	void BuildGlobalTransform();
 	void InitImGui(SDL_Window* window);
 	void CreatePipeline();
 	void CreateFencesAndSemaphores();
 	void InitMainObjects(SDL_Window* window, std::atomic<bool>* ready);
+	// Offscreen color targets that stand in for the swapchain images in headless mode.
+	void CreateOffscreenTargets_Init();
+	std::vector<AllocatedImage> offscreenImages;
 
-	GPUBuffer UploadMesh(std::span<Vertex> vertices);
-	uint32_t ParseGLTFImage(const fastgltf::TextureInfo& imageInfo, const fastgltf::Asset& asset, std::vector<AllocatedImage>& textures);
+	UploadTarget BeginUpload(size_t size);
+	GPUBuffer FinishUpload(UploadTarget& target);
+	uint32_t ParseGLTFImage(const fastgltf::TextureInfo& imageInfo, const fastgltf::Asset& asset, std::vector<AllocatedImage>& textures, TextureUsage usage);
 
 	AllocatedImage CreateDepthImage();
-	AllocatedImage CreateImage(vk::Format format, vk::Extent2D extend, vk::ImageUsageFlags usage, vk::ImageSubresourceRange subresource, bool makeMipmaps = false);
-	AllocatedImage CreateUploadImage(void* data, vk::Format format, vk::Extent2D extend, vk::ImageUsageFlags usage, bool makeMipmaps = false);
-	vk::ImageView  CreateImageView(const vk::Image& image, const vk::Format& format, const vk::ImageSubresourceRange& subresource);
+	// The image gets as many mip levels as the subresource range covers.
+	AllocatedImage CreateImage(vk::Format format, vk::Extent2D extend, vk::ImageUsageFlags usage, vk::ImageSubresourceRange subresource,
+		const vk::ComponentMapping& components = vk::ComponentMapping());
+	// Uploads the levels of the texture from firstLevel on, later submits see the finished image.
+	AllocatedImage CreateUploadImage(const EncodedTexture& texture, vk::ImageUsageFlags usage, uint32_t firstLevel = 0);
+	// Same, but only records the copy into cmd, staging has to stay alive until it executed.
+	AllocatedImage RecordTextureUpload(const EncodedTexture& texture, vk::ImageUsageFlags usage, uint32_t firstLevel, AllocatedBuffer& staging, vk::CommandBuffer& cmd);
+	vk::ImageView  CreateImageView(const vk::Image& image, const vk::Format& format, const vk::ImageSubresourceRange& subresource,
+		const vk::ComponentMapping& components = vk::ComponentMapping());
 
 	// Textures.
 	void CreateDebugTextures();
-	std::vector<vk::DescriptorSet> imageDescSet;
+	// Puts an image into a free slot of the texture table, UINT32_MAX when the table is full.
+	uint32_t AddTexture(AllocatedImage image);
+	// Fills a slot reserved through textureSlots, it must not have been bound yet.
+	void SetTexture(uint32_t slot, AllocatedImage image);
+	// Retires the image, the slot is reused once no frame in flight can sample it anymore.
+	void RemoveTexture(uint32_t slot);
+	void WriteTextureDescriptors(vk::DescriptorSet set, std::span<const uint32_t> slots);
+	// Indexed by slot, sized to the whole table.
 	std::vector<AllocatedImage> textures;
+	SlotAllocator textureSlots;
 	vk::DescriptorSetLayout imageDescLayout;
 	vk::Sampler nearestSampler;
 	vk::Sampler linearSampler;
+	vk::Sampler textureSampler;
+	std::vector<PendingTexture> pendingTextures;
+	std::array<TextureMemory, TEXTURE_USAGE_COUNT> textureMemory;
+
+	// Streaming, every texture slot keeps its encoded mips in system memory to stream from.
+	TextureStreamer textureStreamer;
+	std::vector<EncodedTexture> textureData;
+	uint64_t frameNumber = 0;
 
-	void LoadGLTF(std::filesystem::path path, glm::mat4 transform = glm::mat4(1.0f));
+	void LoadGLTF(std::filesystem::path path, glm::mat4 transform = glm::mat4(1.0f), bool loadGeometry = true);
 	fastgltf::Parser parser;
+	SceneCache sceneCache;
+	bool sceneCacheHit = false;
 
 	GPUBuffer meshBuffer;
+	GPUBuffer sceneAddressBuffer;
+	// Persistently mapped, one FrameConstants slot per frame in flight.
+	GPUBuffer frameConstantRing;
+	size_t frameConstantStride = 0;
 	AllocatedBuffer CreateBuffer(size_t allocSize, vk::Flags<vk::BufferUsageFlagBits> usage, VmaMemoryUsage memUsage);
 	VmaAllocator allocator;
 
 	template<typename T>
-	vk::DeviceAddress UploadData(std::span<T> data);
+	GPUBuffer UploadData(std::span<T> data);
+	// Bytes of vertex data copied on the CPU between the glTF buffers and GPU visible memory.
+	size_t vertexCopyBytes = 0;
 
-	vk::DeviceAddress meshletsAddress;
-	vk::DeviceAddress meshletVerticesAddress;
-	vk::DeviceAddress meshletTrianglesAddress;
+	GPUBuffer meshletBuffer;
+	GPUBuffer meshletVertexBuffer;
+	GPUBuffer meshletTriangleBuffer;
 
-	vk::DeviceAddress meshViewBufferAddress;
-	vk::DeviceAddress materialBufferAddress;
-	vk::DeviceAddress pointLightBufferAddress;
-	vk::DeviceAddress spotLightBufferAddress;
-	vk::DeviceAddress dirLightBufferAddress;
+	GPUBuffer meshViewBuffer;
+	GPUBuffer materialBuffer;
+	GPUBuffer pointLightBuffer;
+	GPUBuffer spotLightBuffer;
+	GPUBuffer dirLightBuffer;
+
+	// Counts that outlive the CPU copies of the scene.
+	SceneInfo sceneInfo;
+	uint32_t meshletCount = 0;
+	uint32_t materialSwitches = 0;
 	glm::mat4 vertexTransform;
 	glm::mat4 worldTransform;
 	glm::vec3 position  = glm::vec3(0);
 	glm::vec3 direction = glm::vec3(0, 0, 1.0f);
 
 	ImVec4 clearColorUI;
+	RendererSettings settings;
 
 	Device device;
 	Swapchain swapchain;
-	std::array<AllocatedImage, IMAGE_COUNT> depthImages;
 	vk::ImageSubresourceRange depthSubresourceRange;
+	vk::Format depthAttachmentFormat = vk::Format::eD24UnormS8Uint;
 
 	Instance instance;
 	Timer frameTimer;
@@ -203,18 +471,61 @@ private:
 	vk::detail::DispatchLoaderDynamic dldid;
 
 	uint32_t currentFrame = 0;
-	std::array<vk::CommandBuffer, 2> cmdBuffers;
-	std::array <vk::Semaphore, 2> imageAquiredSemaphores;
-	std::array <vk::Semaphore, 2> renderFinishedSemaphores;
-	std::array <vk::Fence, 2> inFlightFences;
-	vk::Fence immediateFence;
+	std::vector<FrameResources> frames;
+	// Per swapchain image, presentation of an image has to finish before its semaphore is signalled again.
+	std::vector<vk::Semaphore> renderFinishedSemaphores;
+	// Submits and presents come from two threads, presents take both locks, queue first.
+	// Acquires only take the swapchain lock, so a frame waiting for an image never holds up a submit.
+	std::mutex queueMutex;
+	std::mutex swapchainMutex;
+	SpscQueue<FramePacket, MAX_FRAMES_IN_FLIGHT> submitQueue;
+	// Frames counted but not yet presented, waited on by anything that needs the submission thread idle.
+	std::atomic<uint32_t> pendingSubmits = 0;
+	// Packets actually in the queue so far, the submission thread sleeps on it.
+	std::atomic<uint64_t> pushedSubmits = 0;
+	std::atomic<bool> stopSubmitThread = false;
+	std::thread submitThread;
+	std::atomic<double> inputToSubmitTime = 0;
+	std::atomic<double> eventToSubmitTime = 0;
+	// Last present id handed out on the current swapchain.
+	uint64_t presentId = 0;
+	FrameLimiter frameLimiter;
+	std::function<uint64_t()> inputLatch;
+	std::chrono::steady_clock::time_point inputTime;
+	uint64_t inputEventTime = 0;
+	// One timeline for everything submitted to the graphics queue, frames and uploads alike.
+	// Each submit signals the next value, so any resource can ask whether the work that used it is done.
+	vk::Semaphore graphicsTimeline;
+	uint64_t submittedTimelineValue = 0;
+	uint64_t completedTimelineValue = 0;
+	// Value the next submit signals, what resources touched by the commands being recorded have to wait for.
+	uint64_t NextTimelineValue();
+	bool IsComplete(uint64_t timelineValue);
+	void WaitTimeline(uint64_t timelineValue);
+	uint64_t GetCompletedTimelineValue();
+	// Objects retired against timeline values, and how many the last frame released.
+	DeletionQueue deletionQueue;
+	uint32_t releasedDeletions = 0;
+	// Time the CPU spent blocked on the timeline before reusing a frame.
+	double fenceWaitTime = 0;
+	GpuProfiler gpuProfiler;
+	std::vector<FrameReport> frameReports;
+
+	JobSystem& jobSystem;
+	// Meshlets each scene chunk draws, a multiple of TASK_GROUP_MESHLETS.
+	uint32_t chunkMeshlets = 0;
+	vk::DeviceAddress frameConstantsAddress = 0;
+	std::vector<vk::CommandBuffer> sceneCommands;
+	double recordTime = 0;
+	// Recording time of the benchmark per thread count.
+	std::vector<std::pair<uint32_t, double>> recordBenchmarkResults;
 
 	std::vector<meshopt_Meshlet>	meshlets;
 	std::vector<uint32_t>			meshletVertices;
 	std::vector<uint8_t>			meshletTriangles;
 	std::vector<MeshView>			meshViews;
 	std::vector<Vertex>				vertices;
-	std::vector<MaterialIndexGroup> materialIndexGroups;
+	std::vector<Material>			materials;
 	std::vector<uint32_t>			materialIndices;
 
 	std::vector<uint32_t>			indices;
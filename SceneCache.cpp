@@ -0,0 +1,228 @@
+#include "SceneCache.h"
+#include "Timer.h"
+
+#include <meshoptimizer.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+// Elements per independently decodable chunk.
+constexpr size_t CHUNK_ELEMENTS = 16384;
+
+struct FileHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+};
+struct StreamHeader {
+    uint32_t stride;
+    uint32_t chunkCount;
+    uint64_t count;
+};
+
+SceneCache::SceneCache() {
+
+}
+
+SceneCache::SceneCache(std::filesystem::path path, uint64_t key) : path(path), key(key) {
+
+}
+
+bool SceneCache::Load() {
+    // Nothing of a file that fails halfway may be left behind for SetStream to append to.
+    Reset();
+    std::ifstream file(path, std::ios::ate | std::ios::binary);
+    if (!file)
+        return false;
+    size_t fileSize = static_cast<size_t>(file.tellg());
+    file.seekg(0);
+
+    FileHeader header;
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file || std::memcmp(header.magic, "CRSC", 4) != 0 || header.version != SCENE_CACHE_VERSION || header.key != key)
+        return false;
+
+    for (auto& s : streams) {
+        StreamHeader streamHeader;
+        file.read(reinterpret_cast<char*>(&streamHeader), sizeof(streamHeader));
+        if (!file) {
+            Reset();
+            return false;
+        }
+        s.stride = streamHeader.stride;
+        s.count  = streamHeader.count;
+        s.chunks.resize(streamHeader.chunkCount);
+        file.read(reinterpret_cast<char*>(s.chunks.data()), sizeof(Chunk) * s.chunks.size());
+    }
+    if (!file) {
+        Reset();
+        return false;
+    }
+
+    encoded.resize(fileSize - static_cast<size_t>(file.tellg()));
+    file.read(reinterpret_cast<char*>(encoded.data()), encoded.size());
+    bool valid = static_cast<bool>(file);
+    // Decode trusts the chunk table, so a truncated or damaged one is rejected here.
+    for (const auto& s : streams)
+        for (const auto& chunk : s.chunks)
+            valid = valid && chunk.offset + chunk.encodedSize <= encoded.size() && chunk.first + chunk.count <= s.count;
+    if (!valid) {
+        Reset();
+        return false;
+    }
+    return true;
+}
+
+void SceneCache::Reset() {
+    for (auto& s : streams)
+        s = Stream();
+    encoded.clear();
+}
+
+bool SceneCache::Write() {
+    std::filesystem::create_directories(path.parent_path());
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file)
+        return false;
+
+    FileHeader header = { { 'C', 'R', 'S', 'C' }, SCENE_CACHE_VERSION, key };
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (const auto& s : streams) {
+        StreamHeader streamHeader = { s.stride, static_cast<uint32_t>(s.chunks.size()), s.count };
+        file.write(reinterpret_cast<const char*>(&streamHeader), sizeof(streamHeader));
+        file.write(reinterpret_cast<const char*>(s.chunks.data()), sizeof(Chunk) * s.chunks.size());
+    }
+    file.write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+    return static_cast<bool>(file);
+}
+
+void SceneCache::SetStream(SceneStream stream, const void* data, size_t count, size_t stride) {
+    auto& s  = streams[static_cast<uint32_t>(stream)];
+    s.stride = stride;
+    s.count  = count;
+    s.chunks.clear();
+
+    const auto* bytes = static_cast<const unsigned char*>(data);
+    for (size_t first = 0; first < count; first += CHUNK_ELEMENTS) {
+        Chunk chunk;
+        chunk.first  = first;
+        chunk.count  = std::min(CHUNK_ELEMENTS, count - first);
+        chunk.offset = encoded.size();
+
+        encoded.resize(chunk.offset + meshopt_encodeVertexBufferBound(chunk.count, stride));
+        chunk.encodedSize = meshopt_encodeVertexBuffer(encoded.data() + chunk.offset, encoded.size() - chunk.offset,
+            bytes + first * stride, chunk.count, stride);
+        encoded.resize(chunk.offset + chunk.encodedSize);
+        s.chunks.emplace_back(chunk);
+    }
+}
+
+void SceneCache::SetStream(SceneStream stream, const void* data, std::span<const uint32_t> order, size_t stride) {
+    auto& s  = streams[static_cast<uint32_t>(stream)];
+    s.stride = stride;
+    s.count  = order.size();
+    s.chunks.clear();
+
+    const auto* bytes = static_cast<const unsigned char*>(data);
+    std::vector<unsigned char> gathered(CHUNK_ELEMENTS * stride);
+    for (size_t first = 0; first < order.size(); first += CHUNK_ELEMENTS) {
+        Chunk chunk;
+        chunk.first  = first;
+        chunk.count  = std::min(CHUNK_ELEMENTS, order.size() - first);
+        chunk.offset = encoded.size();
+        for (size_t i = 0; i < chunk.count; i++)
+            std::memcpy(gathered.data() + i * stride, bytes + order[first + i] * stride, stride);
+
+        encoded.resize(chunk.offset + meshopt_encodeVertexBufferBound(chunk.count, stride));
+        chunk.encodedSize = meshopt_encodeVertexBuffer(encoded.data() + chunk.offset, encoded.size() - chunk.offset,
+            gathered.data(), chunk.count, stride);
+        encoded.resize(chunk.offset + chunk.encodedSize);
+        s.chunks.emplace_back(chunk);
+    }
+}
+
+size_t SceneCache::GetCount(SceneStream stream) {
+    return streams[static_cast<uint32_t>(stream)].count;
+}
+
+size_t SceneCache::GetDecodedSize(SceneStream stream) {
+    const auto& s = streams[static_cast<uint32_t>(stream)];
+    return s.count * s.stride;
+}
+
+size_t SceneCache::GetEncodedSize(SceneStream stream) {
+    size_t size = 0;
+    for (const auto& c : streams[static_cast<uint32_t>(stream)].chunks)
+        size += c.encodedSize;
+    return size;
+}
+
+bool SceneCache::Decode(SceneStream stream, void* destination, uint32_t threadCount) {
+    const auto& s = streams[static_cast<uint32_t>(stream)];
+    std::atomic<size_t> nextChunk = 0;
+    std::atomic<bool>   failed    = false;
+
+    auto decodeChunks = [&]() {
+        for (size_t c = nextChunk++; c < s.chunks.size(); c = nextChunk++) {
+            const auto& chunk = s.chunks[c];
+            auto* out = static_cast<unsigned char*>(destination) + chunk.first * s.stride;
+            if (meshopt_decodeVertexBuffer(out, chunk.count, s.stride, encoded.data() + chunk.offset, chunk.encodedSize) != 0)
+                failed = true;
+        }
+    };
+    std::vector<std::thread> threads;
+    for (uint32_t i = 1; i < std::min<size_t>(threadCount, s.chunks.size()); i++)
+        threads.emplace_back(decodeChunks);
+    decodeChunks();
+    for (auto& t : threads)
+        t.join();
+    return !failed;
+}
+
+void SceneCache::Benchmark(uint32_t threadCount) {
+    size_t decodedSize = 0;
+    for (uint32_t i = 0; i < static_cast<uint32_t>(SceneStream::eCount); i++)
+        decodedSize += GetDecodedSize(static_cast<SceneStream>(i));
+    std::vector<unsigned char> source(decodedSize);
+    std::vector<unsigned char> destination(decodedSize);
+
+    auto decodeAll = [&](uint32_t threads) {
+        Timer timer = Timer();
+        size_t offset = 0;
+        for (uint32_t i = 0; i < static_cast<uint32_t>(SceneStream::eCount); i++) {
+            Decode(static_cast<SceneStream>(i), source.data() + offset, threads);
+            offset += GetDecodedSize(static_cast<SceneStream>(i));
+        }
+        return timer.GetMicroseconds();
+    };
+    // Warm up the pages once so neither measurement pays for page faults.
+    decodeAll(threadCount);
+    std::memcpy(destination.data(), source.data(), decodedSize);
+
+    double singleTime = decodeAll(1);
+    double multiTime  = decodeAll(threadCount);
+    Timer timer = Timer();
+    std::memcpy(destination.data(), source.data(), decodedSize);
+    double copyTime = timer.GetMicroseconds();
+
+    // Bytes per microsecond * 0.001 = GB/s.
+    auto throughput = [&](double microseconds) { return decodedSize / std::max(microseconds, 1.0) * 0.001; };
+    std::cout << "Scene cache: " << encoded.size() << " Bytes encoded, " << decodedSize << " Bytes decoded ("
+        << static_cast<double>(decodedSize) / encoded.size() << "x)\n";
+    std::cout << "  Decode, 1 thread: "  << throughput(singleTime) << " GB/s\n";
+    std::cout << "  Decode, " << threadCount << " threads: " << throughput(multiTime) << " GB/s\n";
+    std::cout << "  Raw copy: "          << throughput(copyTime) << " GB/s\n";
+}
+
+uint64_t HashBytes(uint64_t hash, const void* data, size_t size) {
+    const auto* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
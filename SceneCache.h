@@ -0,0 +1,69 @@
+#pragma once
+
+#include <filesystem>
+#include <span>
+#include <vector>
+#include <cstdint>
+
+// Bump whenever the layout or ordering of any cached stream changes.
+constexpr uint32_t SCENE_CACHE_VERSION = 3;
+
+// Geometry streams stored in the scene cache, in file order.
+enum class SceneStream : uint32_t {
+	eVertices,
+	eMeshlets,
+	eMeshletVertices,
+	eMeshletTriangles,
+	eMeshViews,
+	eCount
+};
+
+// Processed scene geometry compressed with the meshopt vertex codec.
+// Every stream is split into independently encoded chunks so it can be decoded on several threads at once.
+class SceneCache
+{
+public:
+	SceneCache();
+	SceneCache(std::filesystem::path path, uint64_t key);
+
+	// Reads the file, false if it is missing or was written for another key or version.
+	bool Load();
+	bool Write();
+
+	// Stride has to be a multiple of 4 and at most 256 bytes.
+	void SetStream(SceneStream stream, const void* data, size_t count, size_t stride);
+	// Element i of the stream is element order[i] of data, gathered one chunk at a time instead of into a reordered copy.
+	void SetStream(SceneStream stream, const void* data, std::span<const uint32_t> order, size_t stride);
+	size_t GetCount(SceneStream stream);
+	size_t GetDecodedSize(SceneStream stream);
+	size_t GetEncodedSize(SceneStream stream);
+	// Decodes all chunks of a stream in parallel, destination must hold GetDecodedSize bytes.
+	bool Decode(SceneStream stream, void* destination, uint32_t threadCount);
+
+	// Compares decode throughput against a plain copy of the same data and prints it.
+	void Benchmark(uint32_t threadCount);
+
+	std::filesystem::path path;
+private:
+	struct Chunk {
+		uint64_t offset;
+		uint64_t encodedSize;
+		uint64_t first;
+		uint64_t count;
+	};
+	struct Stream {
+		uint32_t stride = 0;
+		uint64_t count  = 0;
+		std::vector<Chunk> chunks;
+	};
+
+	// Drops every stream and all encoded data.
+	void Reset();
+
+	uint64_t key = 0;
+	Stream streams[static_cast<uint32_t>(SceneStream::eCount)];
+	std::vector<unsigned char> encoded;
+};
+
+// Hashes bytes into a running 64-bit FNV-1a key.
+uint64_t HashBytes(uint64_t hash, const void* data, size_t size);
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Hands out indices into a fixed size table, freed indices are reused before the table grows.
+class SlotAllocator {
+public:
+	SlotAllocator() {}
+	SlotAllocator(uint32_t capacity) : capacity(capacity) {}
+
+	// UINT32_MAX when every slot is taken.
+	uint32_t Allocate() {
+		if (!freeSlots.empty()) {
+			const uint32_t slot = freeSlots.back();
+			freeSlots.pop_back();
+			return slot;
+		}
+		return end < capacity ? end++ : UINT32_MAX;
+	}
+	void Free(uint32_t slot) {
+		freeSlots.emplace_back(slot);
+	}
+
+	uint32_t GetCapacity() {
+		return capacity;
+	}
+	// One past the highest slot ever handed out, nothing above it is bound.
+	uint32_t GetEnd() {
+		return end;
+	}
+	uint32_t GetUsedCount() {
+		return end - static_cast<uint32_t>(freeSlots.size());
+	}
+private:
+	std::vector<uint32_t> freeSlots;
+	uint32_t end = 0;
+	uint32_t capacity = 0;
+};
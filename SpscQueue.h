@@ -0,0 +1,34 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+// Lock-free ring between exactly one producer and one consumer thread, holds up to Capacity elements.
+template<typename T, size_t Capacity>
+class SpscQueue {
+public:
+	// False when the ring is full.
+	bool Push(const T& value) {
+		const size_t back = tail.load(std::memory_order_relaxed);
+		if (back - head.load(std::memory_order_acquire) == Capacity)
+			return false;
+		items[back % Capacity] = value;
+		tail.store(back + 1, std::memory_order_release);
+		return true;
+	}
+	// False when the ring is empty.
+	bool Pop(T& value) {
+		const size_t front = head.load(std::memory_order_relaxed);
+		if (front == tail.load(std::memory_order_acquire))
+			return false;
+		value = items[front % Capacity];
+		head.store(front + 1, std::memory_order_release);
+		return true;
+	}
+private:
+	std::array<T, Capacity> items;
+	// Apart, so producer and consumer do not share a cache line.
+	alignas(64) std::atomic<size_t> head = 0;
+	alignas(64) std::atomic<size_t> tail = 0;
+};
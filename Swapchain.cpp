@@ -1,25 +1,19 @@
 #include "Swapchain.h"
 
+#include <algorithm>
 #include <iostream>
 
 Swapchain::Swapchain() {
 
 }
 
-Swapchain::Swapchain(vk::Device* device, vk::PhysicalDevice& physicalDevice, vk::SurfaceKHR& surface) : surface(surface) {
+Swapchain::Swapchain(vk::Device* device, vk::PhysicalDevice& physicalDevice, vk::SurfaceKHR& surface, uint32_t imageCount, vk::PresentModeKHR wantedPresentMode) : surface(surface) {
     // Get surface capabilities.
     auto surfaceCapabilities = physicalDevice.getSurfaceCapabilitiesKHR(surface);
-    auto surfacePresentModes = physicalDevice.getSurfacePresentModesKHR(surface);
     auto surfaceFormats      = physicalDevice.getSurfaceFormatsKHR(surface);
+    supportedPresentModes    = physicalDevice.getSurfacePresentModesKHR(surface);
 
-    bool supportsFifo = false;
-    for (auto p : surfacePresentModes) {
-        if (p == vk::PresentModeKHR::eFifo) {
-            supportsFifo = true;
-            break;
-        }
-    }
-    if (!supportsFifo) std::runtime_error("No monitor found that supports FIFO, please ensure a monitor is connected to the GPU.");
+    if (!SupportsPresentMode(vk::PresentModeKHR::eFifo)) std::runtime_error("No monitor found that supports FIFO, please ensure a monitor is connected to the GPU.");
 
     bool supportsSRGBformat = false;
     renderFormat = vk::Format::eR8G8B8A8Srgb;
@@ -33,37 +27,78 @@ Swapchain::Swapchain(vk::Device* device, vk::PhysicalDevice& physicalDevice, vk:
     if (!supportsSRGBformat) std::runtime_error("No monitor found that supports sRGB, please ensure a monitor is connected to the GPU.");
 
     renderExtend = surfaceCapabilities.maxImageExtent;
+    minImageCount = std::max(imageCount, surfaceCapabilities.minImageCount);
+    maxImageCount = surfaceCapabilities.maxImageCount;
+    if (maxImageCount != 0)
+        minImageCount = std::min(minImageCount, maxImageCount);
+    presentMode = PickPresentMode(wantedPresentMode);
 
     vk::SwapchainCreateInfoKHR swapchainInfo = vk::SwapchainCreateInfoKHR()
         .setSurface(surface)
-        .setMinImageCount(IMAGE_COUNT)
+        .setMinImageCount(GetImageCount())
         .setImageFormat(renderFormat)
         .setImageUsage(vk::ImageUsageFlagBits::eColorAttachment)
         .setImageArrayLayers(1)
         .setImageColorSpace(colorSpace)
         .setImageExtent(renderExtend)
-        .setPresentMode(vk::PresentModeKHR::eFifo);
+        .setPresentMode(presentMode);
 
     swapchain = device->createSwapchainKHR(swapchainInfo);
     images    = device->getSwapchainImagesKHR(swapchain);
     pDevice   = device;
+    if (images.size() != imageCount)
+        std::cout << "Asked for " << imageCount << " swapchain images, got " << images.size() << "\n";
 
     CreateImageViews();
 }
 
+Swapchain::Swapchain(vk::Extent2D extent, vk::Format format, std::vector<vk::Image> offscreenImages, std::vector<vk::ImageView> offscreenViews) {
+    renderExtend     = extent;
+    renderFormat     = format;
+    images           = std::move(offscreenImages);
+    imageViews       = std::move(offscreenViews);
+    subresourceRange = vk::ImageSubresourceRange()
+        .setAspectMask(vk::ImageAspectFlagBits::eColor)
+        .setBaseMipLevel(0)
+        .setBaseArrayLayer(0)
+        .setLayerCount(1)
+        .setLevelCount(1);
+}
+
+bool Swapchain::IsHeadless() {
+    return !swapchain;
+}
+
 vk::SwapchainKHR Swapchain::Get() {
     return swapchain;
 }
 
-void Swapchain::Cleanup() {
-    for(auto &i : imageViews)
+void Swapchain::Destroy(RetiredSwapchain& retired) {
+    for (auto& i : retired.imageViews)
         pDevice->destroyImageView(i);
-    pDevice->destroySwapchainKHR(swapchain);
+    pDevice->destroySwapchainKHR(retired.swapchain);
+}
+
+bool Swapchain::SupportsPresentMode(vk::PresentModeKHR mode) {
+    return std::find(supportedPresentModes.begin(), supportedPresentModes.end(), mode) != supportedPresentModes.end();
 }
 
-void Swapchain::Recreate(SDL_Window* pWindow, bool vsync) {
-    pDevice->waitIdle();
-    Cleanup();
+vk::PresentModeKHR Swapchain::PickPresentMode(vk::PresentModeKHR wanted) {
+    if (SupportsPresentMode(wanted))
+        return wanted;
+    std::cout << vk::to_string(wanted) << " is not supported by the surface, using FIFO\n";
+    return vk::PresentModeKHR::eFifo;
+}
+
+uint32_t Swapchain::GetImageCount() {
+    // Mailbox needs a spare image to replace the queued one without waiting.
+    const uint32_t count = presentMode == vk::PresentModeKHR::eMailbox ? std::max(minImageCount, 3u) : minImageCount;
+    return maxImageCount != 0 ? std::min(count, maxImageCount) : count;
+}
+
+RetiredSwapchain Swapchain::Recreate(SDL_Window* pWindow, vk::PresentModeKHR wantedPresentMode) {
+    RetiredSwapchain retired = { swapchain, imageViews };
+    presentMode = PickPresentMode(wantedPresentMode);
 
     int w, h;
     SDL_GetWindowSizeInPixels(pWindow, &w, &h);
@@ -71,23 +106,23 @@ void Swapchain::Recreate(SDL_Window* pWindow, bool vsync) {
         .setHeight(h)
         .setWidth(w);
 
+    // Images the old swapchain already handed out stay valid until it is destroyed.
     vk::SwapchainCreateInfoKHR swapchainInfo = vk::SwapchainCreateInfoKHR()
         .setSurface(surface)
-        .setMinImageCount(IMAGE_COUNT)
+        .setMinImageCount(GetImageCount())
         .setImageFormat(renderFormat)
         .setImageUsage(vk::ImageUsageFlagBits::eColorAttachment)
         .setImageArrayLayers(1)
         .setImageColorSpace(colorSpace)
         .setImageExtent(renderExtend)
-        .setPresentMode(vk::PresentModeKHR::eFifo);
-
-    if (!vsync)
-        swapchainInfo.setPresentMode(vk::PresentModeKHR::eImmediate);
+        .setPresentMode(presentMode)
+        .setOldSwapchain(swapchain);
 
     swapchain = pDevice->createSwapchainKHR(swapchainInfo);
     images = pDevice->getSwapchainImagesKHR(swapchain);
 
     CreateImageViews();
+    return retired;
 }
 
 void Swapchain::CreateImageViews() {
@@ -4,17 +4,32 @@
 #include <SDL3/SDL_vulkan.h>
 #include <vulkan/vulkan.hpp>
 
-// The amount of images directly corresponds to the buffering method (2 = double buffering, 3 = triple buffering).
-constexpr uint32_t IMAGE_COUNT = 2;
+// Swapchain replaced by a recreation, destroyed once nothing presents or renders to its images anymore.
+struct RetiredSwapchain {
+	vk::SwapchainKHR swapchain;
+	std::vector<vk::ImageView> imageViews;
+};
 
 class Swapchain
 {
 public:
 	Swapchain();
-	Swapchain(vk::Device* device, vk::PhysicalDevice& pDevice, vk::SurfaceKHR& surface);
+	// The amount of images directly corresponds to the buffering method (2 = double buffering, 3 = triple buffering),
+	// it is clamped to what the surface supports.
+	Swapchain(vk::Device* device, vk::PhysicalDevice& pDevice, vk::SurfaceKHR& surface, uint32_t imageCount = 2, vk::PresentModeKHR presentMode = vk::PresentModeKHR::eFifo);
+	// Headless stand-in without WSI, renders into offscreen images the caller owns and never presents.
+	Swapchain(vk::Extent2D extent, vk::Format format, std::vector<vk::Image> offscreenImages, std::vector<vk::ImageView> offscreenViews);
+	bool IsHeadless();
 	vk::SwapchainKHR Get();
 
-	void Recreate(SDL_Window* pWindow, bool vsync);
+	// Creates the new swapchain from the current one without waiting on the device, the old one is handed back for deferred destruction.
+	RetiredSwapchain Recreate(SDL_Window* pWindow, vk::PresentModeKHR presentMode);
+	void Destroy(RetiredSwapchain& retired);
+	bool SupportsPresentMode(vk::PresentModeKHR mode);
+
+	// Mode actually in use, FIFO whenever the wanted one is not supported.
+	vk::PresentModeKHR presentMode = vk::PresentModeKHR::eFifo;
+	std::vector<vk::PresentModeKHR> supportedPresentModes;
 
 	vk::SwapchainKHR swapchain;
 
@@ -27,8 +42,12 @@ public:
 	std::vector<vk::Image> images;
 private:
 	void CreateImageViews();
-	void Cleanup();
+	// FIFO is the only mode every surface supports.
+	vk::PresentModeKHR PickPresentMode(vk::PresentModeKHR wanted);
+	uint32_t GetImageCount();
 
 	vk::Device* pDevice;
 	vk::ColorSpaceKHR colorSpace;
+	uint32_t minImageCount = 2;
+	uint32_t maxImageCount = 0;
 };
\ No newline at end of file
@@ -0,0 +1,321 @@
+#include "TextureCompression.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <thread>
+
+uint16_t PackColor565(const float* color) {
+    const auto r = static_cast<uint16_t>(std::lround(std::clamp(color[0], 0.0f, 255.0f) * 31.0f / 255.0f));
+    const auto g = static_cast<uint16_t>(std::lround(std::clamp(color[1], 0.0f, 255.0f) * 63.0f / 255.0f));
+    const auto b = static_cast<uint16_t>(std::lround(std::clamp(color[2], 0.0f, 255.0f) * 31.0f / 255.0f));
+    return (r << 11) | (g << 5) | b;
+}
+// Expands like the hardware does, by replicating the high bits.
+void UnpackColor565(uint16_t packed, float* color) {
+    const uint32_t r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+    color[0] = static_cast<float>((r << 3) | (r >> 2));
+    color[1] = static_cast<float>((g << 2) | (g >> 4));
+    color[2] = static_cast<float>((b << 3) | (b >> 2));
+}
+
+void EncodeBC1Block(const unsigned char* texels, unsigned char* block) {
+    float mean[3] = { 0, 0, 0 };
+    for (size_t i = 0; i < 16; i++)
+        for (size_t c = 0; c < 3; c++)
+            mean[c] += texels[i * 4 + c] / 16.0f;
+
+    // Endpoints lie on the principal axis of the block colors, found with a few power iterations.
+    float covariance[3][3] = {};
+    for (size_t i = 0; i < 16; i++)
+        for (size_t a = 0; a < 3; a++)
+            for (size_t b = 0; b < 3; b++)
+                covariance[a][b] += (texels[i * 4 + a] - mean[a]) * (texels[i * 4 + b] - mean[b]);
+    float axis[3] = { 1, 1, 1 };
+    for (size_t iteration = 0; iteration < 4; iteration++) {
+        float next[3];
+        for (size_t a = 0; a < 3; a++)
+            next[a] = covariance[a][0] * axis[0] + covariance[a][1] * axis[1] + covariance[a][2] * axis[2];
+        const float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+        if (length < 1e-6f)
+            break;
+        for (size_t a = 0; a < 3; a++)
+            axis[a] = next[a] / length;
+    }
+    float minT = 0, maxT = 0;
+    for (size_t i = 0; i < 16; i++) {
+        float t = 0;
+        for (size_t c = 0; c < 3; c++)
+            t += (texels[i * 4 + c] - mean[c]) * axis[c];
+        minT = std::min(minT, t);
+        maxT = std::max(maxT, t);
+    }
+    float endpoint0[3], endpoint1[3];
+    for (size_t c = 0; c < 3; c++) {
+        endpoint0[c] = mean[c] + axis[c] * maxT;
+        endpoint1[c] = mean[c] + axis[c] * minT;
+    }
+    uint16_t color0 = PackColor565(endpoint0);
+    uint16_t color1 = PackColor565(endpoint1);
+    // color0 > color1 selects the four color mode.
+    if (color0 < color1)
+        std::swap(color0, color1);
+
+    uint32_t indices = 0;
+    if (color0 != color1) {
+        float palette[4][3];
+        UnpackColor565(color0, palette[0]);
+        UnpackColor565(color1, palette[1]);
+        for (size_t c = 0; c < 3; c++) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        for (size_t i = 0; i < 16; i++) {
+            uint32_t best = 0;
+            float bestDistance = FLT_MAX;
+            for (uint32_t p = 0; p < 4; p++) {
+                float distance = 0;
+                for (size_t c = 0; c < 3; c++)
+                    distance += (texels[i * 4 + c] - palette[p][c]) * (texels[i * 4 + c] - palette[p][c]);
+                if (distance < bestDistance) {
+                    bestDistance = distance;
+                    best = p;
+                }
+            }
+            indices |= best << (i * 2);
+        }
+    }
+    std::memcpy(block,     &color0,  sizeof(color0));
+    std::memcpy(block + 2, &color1,  sizeof(color1));
+    std::memcpy(block + 4, &indices, sizeof(indices));
+}
+void EncodeBC4Block(const unsigned char* texels, uint32_t channel, unsigned char* block) {
+    unsigned char minValue = 255, maxValue = 0;
+    for (size_t i = 0; i < 16; i++) {
+        minValue = std::min(minValue, texels[i * 4 + channel]);
+        maxValue = std::max(maxValue, texels[i * 4 + channel]);
+    }
+    // value0 > value1 selects the eight value mode, equal values decode to value0 for index 0.
+    uint64_t indices = 0;
+    if (maxValue != minValue) {
+        float palette[8] = { static_cast<float>(maxValue), static_cast<float>(minValue) };
+        for (uint32_t p = 2; p < 8; p++)
+            palette[p] = ((8 - p) * palette[0] + (p - 1) * palette[1]) / 7;
+        for (size_t i = 0; i < 16; i++) {
+            uint64_t best = 0;
+            float bestDistance = FLT_MAX;
+            for (uint32_t p = 0; p < 8; p++) {
+                float distance = std::abs(texels[i * 4 + channel] - palette[p]);
+                if (distance < bestDistance) {
+                    bestDistance = distance;
+                    best = p;
+                }
+            }
+            indices |= best << (i * 3);
+        }
+    }
+    block[0] = maxValue;
+    block[1] = minValue;
+    for (size_t i = 0; i < 6; i++)
+        block[2 + i] = static_cast<unsigned char>(indices >> (i * 8));
+}
+
+// Appends one level of RGBA8 pixels to the texture, in the format already chosen for it.
+void EncodeLevel(EncodedTexture& texture, const unsigned char* rgba, uint32_t width, uint32_t height, bool hasAlpha, uint32_t threadCount) {
+    EncodedLevel level = { width, height, texture.data.size(), 0 };
+    const size_t texelCount = static_cast<size_t>(width) * height;
+
+    switch (texture.format) {
+    case vk::Format::eR8G8Unorm:
+        texture.data.resize(level.offset + texelCount * 2);
+        for (size_t i = 0; i < texelCount; i++) {
+            texture.data[level.offset + i * 2]     = rgba[i * 4 + 1];
+            texture.data[level.offset + i * 2 + 1] = rgba[i * 4 + 2];
+        }
+        break;
+    case vk::Format::eR8G8B8A8Srgb:
+        texture.data.insert(texture.data.end(), rgba, rgba + texelCount * 4);
+        break;
+    default: {
+        const size_t blockSize = texture.format == vk::Format::eBc1RgbSrgbBlock ? 8 : 16;
+        auto encodeBlock = [&](const unsigned char* texels, unsigned char* block) {
+            if (texture.format == vk::Format::eBc5UnormBlock) {
+                EncodeBC4Block(texels, 1, block);
+                EncodeBC4Block(texels, 2, block + 8);
+            }
+            else if (hasAlpha) {
+                EncodeBC4Block(texels, 3, block);
+                EncodeBC1Block(texels, block + 8);
+            }
+            else
+                EncodeBC1Block(texels, block);
+        };
+
+        // Rows of blocks are handed out to the threads one at a time.
+        const uint32_t blocksX = (width + 3) / 4;
+        const uint32_t blocksY = (height + 3) / 4;
+        texture.data.resize(level.offset + static_cast<size_t>(blocksX) * blocksY * blockSize);
+        unsigned char* levelData = texture.data.data() + level.offset;
+        std::atomic<uint32_t> nextRow = 0;
+        auto encodeRows = [&]() {
+            unsigned char texels[16 * 4];
+            for (uint32_t by = nextRow++; by < blocksY; by = nextRow++)
+                for (uint32_t bx = 0; bx < blocksX; bx++) {
+                    // Blocks over the edge repeat the last row and column.
+                    for (uint32_t y = 0; y < 4; y++)
+                        for (uint32_t x = 0; x < 4; x++) {
+                            const size_t sx = std::min(bx * 4 + x, width - 1);
+                            const size_t sy = std::min(by * 4 + y, height - 1);
+                            std::memcpy(&texels[(y * 4 + x) * 4], &rgba[(sy * width + sx) * 4], 4);
+                        }
+                    encodeBlock(texels, levelData + (static_cast<size_t>(by) * blocksX + bx) * blockSize);
+                }
+        };
+        std::vector<std::thread> threads;
+        for (uint32_t i = 1; i < std::min(threadCount, blocksY); i++)
+            threads.emplace_back(encodeRows);
+        encodeRows();
+        for (auto& t : threads)
+            t.join();
+        break;
+    }
+    }
+    level.size = texture.data.size() - level.offset;
+    texture.levels.emplace_back(level);
+}
+
+float SRGBToLinear(float value) {
+    return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
+float LinearToSRGB(float value) {
+    return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+}
+
+std::vector<unsigned char> DownsampleLevel(const unsigned char* rgba, uint32_t width, uint32_t height, bool isSRGB) {
+    static const auto toLinear = []() {
+        std::array<float, 256> table;
+        for (size_t i = 0; i < 256; i++)
+            table[i] = SRGBToLinear(i / 255.0f);
+        return table;
+    }();
+    const uint32_t newWidth  = std::max(1u, width / 2);
+    const uint32_t newHeight = std::max(1u, height / 2);
+    std::vector<unsigned char> result(static_cast<size_t>(newWidth) * newHeight * 4);
+
+    for (uint32_t y = 0; y < newHeight; y++) {
+        // Odd sizes clamp the second row and column, so a 1 texel wide side is not read out of bounds.
+        const size_t y0 = std::min(y * 2, height - 1), y1 = std::min(y * 2 + 1, height - 1);
+        for (uint32_t x = 0; x < newWidth; x++) {
+            const size_t x0 = std::min(x * 2, width - 1), x1 = std::min(x * 2 + 1, width - 1);
+            const unsigned char* texels[4] = {
+                &rgba[(y0 * width + x0) * 4], &rgba[(y0 * width + x1) * 4],
+                &rgba[(y1 * width + x0) * 4], &rgba[(y1 * width + x1) * 4]
+            };
+            unsigned char* out = &result[(static_cast<size_t>(y) * newWidth + x) * 4];
+            for (size_t c = 0; c < 4; c++) {
+                // Color is averaged as light, alpha and non color data as stored.
+                if (isSRGB && c < 3) {
+                    const float sum = toLinear[texels[0][c]] + toLinear[texels[1][c]] + toLinear[texels[2][c]] + toLinear[texels[3][c]];
+                    out[c] = static_cast<unsigned char>(std::lround(LinearToSRGB(sum * 0.25f) * 255.0f));
+                }
+                else
+                    out[c] = static_cast<unsigned char>((texels[0][c] + texels[1][c] + texels[2][c] + texels[3][c] + 2) / 4);
+            }
+        }
+    }
+    return result;
+}
+
+EncodedTexture EncodeTexture(const unsigned char* rgba, uint32_t width, uint32_t height, TextureUsage usage, bool compress, bool makeMipmaps, uint32_t threadCount) {
+    EncodedTexture texture;
+    const size_t texelCount = static_cast<size_t>(width) * height;
+
+    // Metallic-roughness only stores G and B, the view puts them back where the shader reads them.
+    if (usage == TextureUsage::eMetallicRoughness)
+        texture.components = vk::ComponentMapping(vk::ComponentSwizzle::eOne, vk::ComponentSwizzle::eR, vk::ComponentSwizzle::eG, vk::ComponentSwizzle::eOne);
+
+    bool hasAlpha = false;
+    if (usage == TextureUsage::eBaseColor)
+        for (size_t i = 0; i < texelCount && !hasAlpha; i++)
+            hasAlpha = rgba[i * 4 + 3] != 255;
+
+    if (usage == TextureUsage::eMetallicRoughness)
+        texture.format = compress ? vk::Format::eBc5UnormBlock : vk::Format::eR8G8Unorm;
+    else if (!compress)
+        texture.format = vk::Format::eR8G8B8A8Srgb;
+    else
+        texture.format = hasAlpha ? vk::Format::eBc3SrgbBlock : vk::Format::eBc1RgbSrgbBlock;
+
+    EncodeLevel(texture, rgba, width, height, hasAlpha, threadCount);
+    if (!makeMipmaps)
+        return texture;
+
+    // Every level is filtered from the previous one, down to 1x1.
+    const bool isSRGB = usage != TextureUsage::eMetallicRoughness;
+    std::vector<unsigned char> level;
+    const unsigned char* previous = rgba;
+    while (width > 1 || height > 1) {
+        level    = DownsampleLevel(previous, width, height, isSRGB);
+        width    = std::max(1u, width / 2);
+        height   = std::max(1u, height / 2);
+        previous = level.data();
+        EncodeLevel(texture, level.data(), width, height, hasAlpha, threadCount);
+    }
+    return texture;
+}
+
+struct TextureCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint32_t format;
+    uint32_t components[4];
+    uint32_t levelCount;
+    uint64_t dataSize;
+};
+
+bool ReadTextureCache(const std::filesystem::path& path, uint64_t key, EncodedTexture& texture) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+    TextureCacheHeader header;
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file || std::memcmp(header.magic, "CRTX", 4) != 0 || header.version != TEXTURE_CACHE_VERSION || header.key != key)
+        return false;
+
+    texture.format     = static_cast<vk::Format>(header.format);
+    texture.components = vk::ComponentMapping(static_cast<vk::ComponentSwizzle>(header.components[0]), static_cast<vk::ComponentSwizzle>(header.components[1]),
+        static_cast<vk::ComponentSwizzle>(header.components[2]), static_cast<vk::ComponentSwizzle>(header.components[3]));
+    texture.levels.resize(header.levelCount);
+    texture.data.resize(header.dataSize);
+    file.read(reinterpret_cast<char*>(texture.levels.data()), sizeof(EncodedLevel) * texture.levels.size());
+    file.read(reinterpret_cast<char*>(texture.data.data()), texture.data.size());
+    return static_cast<bool>(file);
+}
+bool WriteTextureCache(const std::filesystem::path& path, uint64_t key, const EncodedTexture& texture) {
+    std::filesystem::create_directories(path.parent_path());
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file)
+        return false;
+    TextureCacheHeader header = { { 'C', 'R', 'T', 'X' }, TEXTURE_CACHE_VERSION, key, static_cast<uint32_t>(texture.format),
+        { static_cast<uint32_t>(texture.components.r), static_cast<uint32_t>(texture.components.g),
+          static_cast<uint32_t>(texture.components.b), static_cast<uint32_t>(texture.components.a) },
+        static_cast<uint32_t>(texture.levels.size()), texture.data.size() };
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(texture.levels.data()), sizeof(EncodedLevel) * texture.levels.size());
+    file.write(reinterpret_cast<const char*>(texture.data.data()), texture.data.size());
+    return static_cast<bool>(file);
+}
+
+const char* GetTextureUsageName(TextureUsage usage) {
+    switch (usage) {
+    case TextureUsage::eBaseColor:         return "Base color";
+    case TextureUsage::eMetallicRoughness: return "Metallic-roughness";
+    case TextureUsage::eEmissive:          return "Emissive";
+    default:                               return "Unknown";
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+// What a texture is sampled as, decides the format it is stored in.
+enum class TextureUsage : uint32_t {
+	eBaseColor,
+	eMetallicRoughness,
+	eEmissive,
+	eCount
+};
+constexpr uint32_t TEXTURE_USAGE_COUNT = static_cast<uint32_t>(TextureUsage::eCount);
+
+// Bump whenever the encoders or the mip filter change.
+constexpr uint32_t TEXTURE_CACHE_VERSION = 1;
+
+struct EncodedLevel {
+	uint32_t width;
+	uint32_t height;
+	// Bytes into EncodedTexture::data.
+	uint64_t offset;
+	uint64_t size;
+};
+// Texel data ready for upload, together with the format and view swizzle it was encoded for.
+struct EncodedTexture {
+	std::vector<unsigned char> data;
+	std::vector<EncodedLevel> levels;
+	vk::Format format;
+	vk::ComponentMapping components;
+};
+
+// Encodes RGBA8 pixels into the format of their usage.
+// Base color and emissive are sRGB, metallic-roughness keeps only roughness (G) and metallic (B) and is swizzled back into .y and .z.
+// With compress, base color becomes BC1 or BC3 when it has alpha, metallic-roughness BC5 and emissive BC1, encoded on threadCount threads.
+// With makeMipmaps, the full chain down to 1x1 is box filtered on the CPU, sRGB usages in linear space.
+EncodedTexture EncodeTexture(const unsigned char* rgba, uint32_t width, uint32_t height, TextureUsage usage, bool compress, bool makeMipmaps, uint32_t threadCount);
+
+// Encoded textures on disk, false if the file is missing or was written for another key or version.
+bool ReadTextureCache(const std::filesystem::path& path, uint64_t key, EncodedTexture& texture);
+bool WriteTextureCache(const std::filesystem::path& path, uint64_t key, const EncodedTexture& texture);
+
+// Single 4x4 block encoders, texels are 16 RGBA8 texels in row order.
+void EncodeBC1Block(const unsigned char* texels, unsigned char* block);
+void EncodeBC4Block(const unsigned char* texels, uint32_t channel, unsigned char* block);
+
+const char* GetTextureUsageName(TextureUsage usage);
@@ -0,0 +1,137 @@
+#include "TextureStreamer.h"
+
+#include <algorithm>
+#include <numeric>
+
+// Frames without a request after which a texture only needs its tail again.
+constexpr uint64_t REQUEST_TIMEOUT_FRAMES = 240;
+
+TextureStreamer::TextureStreamer() {
+
+}
+
+TextureStreamer::TextureStreamer(size_t budget) : budget(budget) {
+
+}
+
+void TextureStreamer::AddTexture(uint32_t slot, std::vector<uint64_t> levelBytes, uint32_t tailMip) {
+    if (slot >= textures.size())
+        textures.resize(slot + 1);
+    auto& texture = textures[slot];
+    texture.isStreamed   = true;
+    texture.levelBytes   = std::move(levelBytes);
+    texture.tailMip      = std::min<uint32_t>(tailMip, texture.levelBytes.size() - 1);
+    texture.residentMip  = texture.tailMip;
+    texture.requestedMip = texture.tailMip;
+    residentBytes += GetBytes(texture, texture.residentMip);
+}
+
+void TextureStreamer::RemoveTexture(uint32_t slot) {
+    if (slot >= textures.size() || !textures[slot].isStreamed)
+        return;
+    residentBytes -= GetBytes(textures[slot], textures[slot].residentMip);
+    textures[slot] = Texture();
+}
+
+void TextureStreamer::ProcessFeedback(std::span<const uint32_t> requestedMips, uint64_t frame) {
+    for (size_t slot = 0; slot < std::min(requestedMips.size(), textures.size()); slot++) {
+        auto& texture = textures[slot];
+        if (!texture.isStreamed || requestedMips[slot] == UINT32_MAX)
+            continue;
+        texture.requestedMip     = std::min(requestedMips[slot], texture.tailMip);
+        texture.lastRequestFrame = frame;
+    }
+}
+
+std::vector<ResidencyChange> TextureStreamer::Update(uint64_t frame, size_t uploadBytes) {
+    std::vector<uint32_t> loads;
+    std::vector<uint32_t> evictable;
+    for (uint32_t slot = 0; slot < textures.size(); slot++) {
+        auto& texture = textures[slot];
+        if (!texture.isStreamed)
+            continue;
+        if (frame - texture.lastRequestFrame > REQUEST_TIMEOUT_FRAMES)
+            texture.requestedMip = texture.tailMip;
+        if (texture.requestedMip < texture.residentMip)
+            loads.emplace_back(slot);
+        else if (texture.requestedMip > texture.residentMip)
+            evictable.emplace_back(slot);
+    }
+    // Largest gap between wanted and resident first, evictions start with the texture requested longest ago.
+    std::sort(loads.begin(), loads.end(), [&](uint32_t a, uint32_t b) {
+        const auto gapA = textures[a].residentMip - textures[a].requestedMip;
+        const auto gapB = textures[b].residentMip - textures[b].requestedMip;
+        return gapA != gapB ? gapA > gapB : textures[a].lastRequestFrame > textures[b].lastRequestFrame;
+    });
+    std::sort(evictable.begin(), evictable.end(), [&](uint32_t a, uint32_t b) { return textures[a].lastRequestFrame < textures[b].lastRequestFrame; });
+
+    std::vector<ResidencyChange> changes;
+    size_t uploaded    = 0;
+    size_t nextEvicted = 0;
+    auto setResidentMip = [&](uint32_t slot, uint32_t mip) {
+        auto& texture = textures[slot];
+        residentBytes = residentBytes - GetBytes(texture, texture.residentMip) + GetBytes(texture, mip);
+        texture.residentMip = mip;
+        uploaded += GetBytes(texture, mip);
+        changes.emplace_back(slot, mip);
+    };
+    for (uint32_t slot : loads) {
+        auto& texture = textures[slot];
+        // Finest level whose upload, and the re-uploads of the evictions it needs, fit this frame.
+        // Settles for a coarser level when the budget or the upload limit is still short, nothing is evicted for a load that is skipped.
+        for (uint32_t mip = texture.requestedMip; mip < texture.residentMip; mip++) {
+            const size_t loadBytes   = GetBytes(texture, mip);
+            const size_t newResident = residentBytes - GetBytes(texture, texture.residentMip) + loadBytes;
+            size_t freedBytes   = 0;
+            size_t evictUpload  = 0;
+            size_t evictedCount = 0;
+            while (newResident - freedBytes > budget && nextEvicted + evictedCount < evictable.size()) {
+                const auto& evicted = textures[evictable[nextEvicted + evictedCount++]];
+                freedBytes  += GetBytes(evicted, evicted.residentMip) - GetBytes(evicted, evicted.requestedMip);
+                evictUpload += GetBytes(evicted, evicted.requestedMip);
+            }
+            if (newResident - freedBytes > budget || uploaded + evictUpload + loadBytes > uploadBytes)
+                continue;
+            for (size_t i = 0; i < evictedCount; i++) {
+                const uint32_t evicted = evictable[nextEvicted++];
+                setResidentMip(evicted, textures[evicted].requestedMip);
+                evictionCount++;
+            }
+            setResidentMip(slot, mip);
+            loadCount++;
+            break;
+        }
+    }
+    return changes;
+}
+
+uint32_t TextureStreamer::GetResidentMip(uint32_t slot) {
+    return slot < textures.size() ? textures[slot].residentMip : 0;
+}
+
+size_t TextureStreamer::GetResidentBytes() {
+    return residentBytes;
+}
+
+size_t TextureStreamer::GetBudget() {
+    return budget;
+}
+
+uint32_t TextureStreamer::GetPendingRequests() {
+    uint32_t pending = 0;
+    for (const auto& t : textures)
+        pending += t.isStreamed && t.requestedMip < t.residentMip;
+    return pending;
+}
+
+uint32_t TextureStreamer::GetLoadCount() {
+    return loadCount;
+}
+
+uint32_t TextureStreamer::GetEvictionCount() {
+    return evictionCount;
+}
+
+size_t TextureStreamer::GetBytes(const Texture& texture, uint32_t mip) {
+    return std::accumulate(texture.levelBytes.begin() + mip, texture.levelBytes.end(), size_t(0));
+}
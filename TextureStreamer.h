@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// New first resident mip level of a texture slot.
+struct ResidencyChange {
+	uint32_t slot;
+	uint32_t residentMip;
+};
+
+// Decides which mip levels of each texture are resident, from the levels the GPU asked for and a VRAM budget.
+// Only bookkeeping, the renderer performs the uploads and view swaps the returned changes describe.
+class TextureStreamer
+{
+public:
+	TextureStreamer();
+	TextureStreamer(size_t budget);
+
+	// Registers a texture resident from tailMip on, levels past the tail are never evicted.
+	void AddTexture(uint32_t slot, std::vector<uint64_t> levelBytes, uint32_t tailMip);
+	void RemoveTexture(uint32_t slot);
+	// Finest level sampled per slot in a finished frame, UINT32_MAX for slots that were not sampled.
+	void ProcessFeedback(std::span<const uint32_t> requestedMips, uint64_t frame);
+	// Picks the residency changes for this frame, the changed textures are re-uploaded so at most uploadBytes are picked, evictions included.
+	// Textures that were not requested recently are evicted first when a load does not fit the budget.
+	std::vector<ResidencyChange> Update(uint64_t frame, size_t uploadBytes);
+
+	uint32_t GetResidentMip(uint32_t slot);
+	size_t GetResidentBytes();
+	size_t GetBudget();
+	uint32_t GetPendingRequests();
+	uint32_t GetLoadCount();
+	uint32_t GetEvictionCount();
+
+private:
+	struct Texture {
+		bool isStreamed = false;
+		std::vector<uint64_t> levelBytes;
+		uint32_t tailMip = 0;
+		uint32_t residentMip = 0;
+		uint32_t requestedMip = 0;
+		uint64_t lastRequestFrame = 0;
+	};
+	// Bytes of a texture when resident from mip on.
+	size_t GetBytes(const Texture& texture, uint32_t mip);
+
+	std::vector<Texture> textures;
+	size_t budget = 0;
+	size_t residentBytes = 0;
+	uint32_t loadCount = 0;
+	uint32_t evictionCount = 0;
+};
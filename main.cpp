@@ -10,13 +10,96 @@
 
 #include "InputHandler.h"
 #include "Renderer.h"
+#include "FrameStats.h"
+#include "CameraPath.h"
 
 #include <SDL3/SDL.h>
 
 #include <iostream>
 #include <atomic>
+#include <fstream>
+#include <string>
 #include <thread>
 
+// Command line options, everything not given keeps the renderer's defaults.
+struct Options {
+    RendererSettings settings;
+    // Frames to render before exiting, 0 runs until escape is pressed.
+    uint32_t frameCount = 0;
+    // Frames left out of the statistics while caches and clocks settle.
+    uint32_t warmupFrames = 10;
+    std::filesystem::path statsPath;
+    // Replayed instead of reading input, advanced by pathStep seconds every frame after the warmup.
+    std::filesystem::path cameraPath;
+    double pathStep = 1.0 / 60;
+    std::filesystem::path csvPath;
+    // Records CPU zones from the start and writes them as a Chrome trace on exit.
+    std::filesystem::path tracePath;
+};
+// One recorded frame of a camera path replay.
+struct PathFrame {
+    uint64_t frame;
+    double pathTime;
+    double frameTime;
+    // Time Draw took, without waiting on the limiter and the GPU.
+    double cpuTime;
+    double gpuTime;
+    uint32_t meshlets;
+    uint32_t lights;
+    std::vector<GpuPassResult> passes;
+};
+// GPU times of one pass over the measured frames, and its summed shader invocations.
+struct PassTotals {
+    std::string name;
+    FrameStats times;
+    double taskInvocations = 0;
+    double meshInvocations = 0;
+    double fragmentInvocations = 0;
+};
+
+bool ParseArguments(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        const bool hasValue   = i + 1 < argc;
+        if (arg == "--headless")
+            options.settings.headless = true;
+        else if (arg == "--bench-cache")
+            options.settings.benchmarkSceneCache = true;
+        else if (arg == "--frames" && hasValue)
+            options.frameCount = std::stoul(argv[++i]);
+        else if (arg == "--warmup" && hasValue)
+            options.warmupFrames = std::stoul(argv[++i]);
+        else if (arg == "--width" && hasValue)
+            options.settings.headlessExtent.width = std::stoul(argv[++i]);
+        else if (arg == "--height" && hasValue)
+            options.settings.headlessExtent.height = std::stoul(argv[++i]);
+        else if (arg == "--stats-json" && hasValue)
+            options.statsPath = argv[++i];
+        else if (arg == "--camera-path" && hasValue)
+            options.cameraPath = argv[++i];
+        else if (arg == "--path-step" && hasValue)
+            options.pathStep = std::stod(argv[++i]);
+        else if (arg == "--csv" && hasValue)
+            options.csvPath = argv[++i];
+        else if (arg == "--trace" && hasValue)
+            options.tracePath = argv[++i];
+        else {
+            std::cout << "Unknown argument " << arg << "\n"
+                << "Usage: ChapterRenderer [--headless] [--width W] [--height H] [--frames N] [--warmup N] [--stats-json path] [--bench-cache]\n"
+                << "                       [--camera-path file] [--path-step seconds] [--csv path] [--trace path]\n";
+            return false;
+        }
+    }
+    if (options.pathStep <= 0) {
+        std::cout << "--path-step has to be positive\n";
+        return false;
+    }
+    // Headless runs have nobody to press escape, a camera path ends on its own.
+    if (options.settings.headless && options.frameCount == 0 && options.cameraPath.empty())
+        options.frameCount = 1000;
+    return true;
+}
+
 SDL_Window* CreateVulkanWindow(const char* title, int width = 1280, int height = 720) {
     if (!SDL_Init(SDL_INIT_VIDEO)) {
         std::cout << "Could not initialize SDL. Please ensure your system detects any monitor before continuing." << std::endl;
@@ -31,50 +114,238 @@ SDL_Window* CreateVulkanWindow(const char* title, int width = 1280, int height =
     return window;
 }
 
-void doRendering(std::atomic<bool>* stillRunning, std::atomic<bool>* ready) {
+void PrintPasses(std::vector<PassTotals>& passTotals) {
+    for (auto& pass : passTotals) {
+        const double count = std::max<double>(1, pass.times.GetCount());
+        std::cout << "GPU pass " << pass.name << ": mean " << pass.times.GetMean() << " ms, p95 " << pass.times.GetPercentile(0.95) << " ms, per frame "
+            << pass.taskInvocations / count << " task, " << pass.meshInvocations / count << " mesh, " << pass.fragmentInvocations / count << " fragment invocations\n";
+    }
+}
+
+// One column per pass, frames without a pass leave its column empty.
+bool WritePathCsv(const std::filesystem::path& path, const std::vector<PathFrame>& frames, const std::vector<PassTotals>& passTotals) {
+    std::ofstream file(path);
+    if (!file)
+        return false;
+    file << "frame,pathTime,frameMs,cpuMs,gpuMs,meshlets,lights";
+    for (const auto& pass : passTotals)
+        file << "," << pass.name << "Ms";
+    file << "\n";
+    for (const auto& f : frames) {
+        file << f.frame << "," << f.pathTime << "," << f.frameTime << "," << f.cpuTime << "," << f.gpuTime << "," << f.meshlets << "," << f.lights;
+        for (const auto& pass : passTotals) {
+            file << ",";
+            for (const auto& result : f.passes)
+                if (result.name == pass.name)
+                    file << result.time;
+        }
+        file << "\n";
+    }
+    return file.good();
+}
+
+// Summaries of the frame, CPU and GPU times next to the scene counts.
+bool WritePathJson(const std::filesystem::path& path, const std::vector<PathFrame>& frames, FrameStats& frameStats, FrameStats& cpuStats, FrameStats& gpuStats,
+    std::vector<PassTotals>& passTotals, const std::vector<std::pair<std::string, std::string>>& labels) {
+    std::ofstream file(path);
+    if (!file)
+        return false;
+    file << "{\n";
+    for (const auto& [key, value] : labels)
+        file << "  \"" << EscapeJson(key) << "\": \"" << EscapeJson(value) << "\",\n";
+    file << "  \"meshlets\": " << (frames.empty() ? 0 : frames.back().meshlets) << ",\n";
+    file << "  \"lights\": " << (frames.empty() ? 0 : frames.back().lights) << ",\n";
+    const std::array<std::pair<const char*, FrameStats*>, 3> series = { { { "frame", &frameStats }, { "cpu", &cpuStats }, { "gpu", &gpuStats } } };
+    for (size_t i = 0; i < series.size(); i++) {
+        file << "  \"" << series[i].first << "\": {\n";
+        series[i].second->WriteSummary(file, "    ");
+        file << "\n  },\n";
+    }
+    // Invocations are means per frame.
+    file << "  \"passes\": {\n";
+    for (size_t i = 0; i < passTotals.size(); i++) {
+        auto& pass = passTotals[i];
+        const double count = std::max<double>(1, pass.times.GetCount());
+        file << "    \"" << pass.name << "\": {\n";
+        pass.times.WriteSummary(file, "      ");
+        file << ",\n      \"taskInvocations\": " << pass.taskInvocations / count << ",\n";
+        file << "      \"meshInvocations\": " << pass.meshInvocations / count << ",\n";
+        file << "      \"fragmentInvocations\": " << pass.fragmentInvocations / count << "\n";
+        file << "    }" << (i + 1 < passTotals.size() ? "," : "") << "\n";
+    }
+    file << "  }\n}\n";
+    return file.good();
+}
+
+void doRendering(JobSystem* jobSystem, Options* options) {
+    // A path runs its warmup at the first keyframe, then one step per frame until its end.
+    CameraPath cameraPath;
+    const bool replay = !options->cameraPath.empty();
+    if (replay) {
+        if (!cameraPath.Load(options->cameraPath))
+            return;
+        options->frameCount = options->warmupFrames + static_cast<uint32_t>(cameraPath.GetDuration() / options->pathStep) + 1;
+    }
+    // Runs with a fixed length are benchmarks, they collect the GPU passes of every frame.
+    options->settings.reportFrames = options->frameCount > 0;
+
     // Window creation.
-    SDL_Window* window = CreateVulkanWindow("Chapter One");
-    Renderer renderer(window, ready);
-    bool grabMouse   = true;
+    SDL_Window* window = options->settings.headless ? nullptr : CreateVulkanWindow("Chapter One");
+    std::atomic<bool> ready = false;
+    Renderer renderer(window, &ready, *jobSystem, options->settings);
+    std::cout << "Ready!\n";
+    bool grabMouse    = true;
+    bool stillRunning = true;
 
     SDL_Event event;
     InputHandler input(window);
-    while (*stillRunning) {
-        *stillRunning = input.PollEvents(event, grabMouse, renderer.pitch, renderer.yaw);
-        *stillRunning = !input.IsPressed(SDL_SCANCODE_ESCAPE);
-
-        // Movement.
-        float velocity = input.IsHeld(SDL_SCANCODE_LSHIFT) ? 0.5f : 0.1f;
-        float forward  = input.IsHeld(SDL_SCANCODE_W) ? velocity : input.IsHeld(SDL_SCANCODE_S) ? -velocity : 0;
-        float sideward = input.IsHeld(SDL_SCANCODE_A) ? velocity : input.IsHeld(SDL_SCANCODE_D) ? -velocity : 0;
-        renderer.Move(forward, sideward);
-        
-        if (input.IsPressed(SDL_SCANCODE_F)) {
-            grabMouse = !grabMouse;
-            SDL_SetWindowMouseGrab(window, grabMouse);
-            SDL_SetWindowRelativeMouseMode(window, grabMouse);
-        }
-        // Currently the "worst case benchmarking point".
-        if (input.IsPressed(SDL_SCANCODE_G))
-            renderer.Teleport(glm::vec3(24, 4, 14.5f));
+    // The renderer reads input itself, as late as its latency mode allows.
+    if (window)
+        renderer.SetInputLatch([&]() {
+            float pitch = renderer.pitch;
+            float yaw   = renderer.yaw;
+            stillRunning = input.PollEvents(event, grabMouse, pitch, yaw);
+            stillRunning = !input.IsPressed(SDL_SCANCODE_ESCAPE);
+            // A replayed path owns the camera, input can only end the run.
+            if (replay)
+                return input.GetOldestEventTime();
+            renderer.pitch = pitch;
+            renderer.yaw   = yaw;
+
+            // Movement.
+            float velocity = input.IsHeld(SDL_SCANCODE_LSHIFT) ? 0.5f : 0.1f;
+            float forward  = input.IsHeld(SDL_SCANCODE_W) ? velocity : input.IsHeld(SDL_SCANCODE_S) ? -velocity : 0;
+            float sideward = input.IsHeld(SDL_SCANCODE_A) ? velocity : input.IsHeld(SDL_SCANCODE_D) ? -velocity : 0;
+            renderer.Move(forward, sideward);
 
-        // Send position and rotation to logic handler.
+            if (input.IsPressed(SDL_SCANCODE_F)) {
+                grabMouse = !grabMouse;
+                SDL_SetWindowMouseGrab(window, grabMouse);
+                SDL_SetWindowRelativeMouseMode(window, grabMouse);
+            }
+            // Currently the "worst case benchmarking point".
+            if (input.IsPressed(SDL_SCANCODE_G))
+                renderer.Teleport(glm::vec3(24, 4, 14.5f));
+            return input.GetOldestEventTime();
+        });
 
+    // Frame times are taken between the ends of consecutive frames, so they include any wait on the GPU.
+    FrameStats stats;
+    std::vector<PathFrame> pathFrames;
+    std::vector<PassTotals> passTotals;
+    uint64_t firstMeasuredFrame = UINT64_MAX;
+    // GPU reports arrive frames in flight later, they are matched to the recorded frames by number.
+    auto addReports = [&](const std::vector<FrameReport>& reports) {
+        for (const auto& report : reports) {
+            if (report.frame < firstMeasuredFrame)
+                continue;
+            for (const auto& result : report.passes) {
+                auto pass = std::find_if(passTotals.begin(), passTotals.end(), [&](const PassTotals& p) { return p.name == result.name; });
+                if (pass == passTotals.end())
+                    pass = passTotals.insert(passTotals.end(), PassTotals{ result.name });
+                pass->times.Add(result.time);
+                pass->taskInvocations     += result.taskInvocations;
+                pass->meshInvocations     += result.meshInvocations;
+                pass->fragmentInvocations += result.fragmentInvocations;
+            }
+            if (pathFrames.empty() || report.frame - pathFrames.front().frame >= pathFrames.size())
+                continue;
+            auto& pathFrame    = pathFrames[report.frame - pathFrames.front().frame];
+            pathFrame.gpuTime  = report.gpuTime;
+            pathFrame.meshlets = report.meshlets;
+            pathFrame.lights   = report.lights;
+            pathFrame.passes   = report.passes;
+        }
+    };
+    Timer frameTimer = Timer();
+    for (uint32_t frame = 0; stillRunning && (options->frameCount == 0 || frame < options->frameCount); frame++) {
+        const double pathTime = frame < options->warmupFrames ? 0 : (frame - options->warmupFrames) * options->pathStep;
+        if (replay) {
+            const auto pose = cameraPath.Sample(static_cast<float>(pathTime));
+            renderer.SetCamera(pose.position, pose.yaw, pose.pitch);
+        }
+        const uint64_t frameNumber = renderer.GetFrameNumber();
+        if (frame == options->warmupFrames)
+            firstMeasuredFrame = frameNumber;
+        Timer drawTimer = Timer();
         renderer.Draw();
+        const double cpuTime = std::max(0.0, drawTimer.GetMilliseconds() - renderer.GetWaitTime());
+        if (frame >= options->warmupFrames) {
+            const double frameTime = frameTimer.GetMilliseconds();
+            stats.Add(frameTime);
+            if (replay)
+                pathFrames.emplace_back(frameNumber, pathTime, frameTime, cpuTime, 0.0, 0u, 0u);
+        }
+        frameTimer.Reset();
+        addReports(renderer.TakeFrameReports());
+    }
+    if (options->settings.reportFrames) {
+        renderer.Flush();
+        addReports(renderer.TakeFrameReports());
     }
+
+    if (stats.GetCount() == 0)
+        return;
+    stats.Print();
+    PrintPasses(passTotals);
+    const vk::Extent2D extent = renderer.GetRenderExtent();
+    const std::vector<std::pair<std::string, std::string>> labels = {
+        { "device", renderer.GetDeviceName() },
+        { "mode", options->settings.headless ? "headless" : "windowed" },
+        { "resolution", std::to_string(extent.width) + "x" + std::to_string(extent.height) }
+    };
+    if (replay) {
+        FrameStats cpuStats, gpuStats;
+        for (const auto& f : pathFrames) {
+            cpuStats.Add(f.cpuTime);
+            gpuStats.Add(f.gpuTime);
+        }
+        std::cout << "CPU: ";
+        cpuStats.Print();
+        std::cout << "GPU: ";
+        gpuStats.Print();
+        auto pathLabels = labels;
+        pathLabels.emplace_back("cameraPath", options->cameraPath.generic_string());
+        pathLabels.emplace_back("pathStep", std::to_string(options->pathStep));
+        if (!options->csvPath.empty())
+            std::cout << (WritePathCsv(options->csvPath, pathFrames, passTotals) ? "Wrote per frame results to " : "Could not write per frame results to ") << options->csvPath << "\n";
+        if (!options->statsPath.empty())
+            std::cout << (WritePathJson(options->statsPath, pathFrames, stats, cpuStats, gpuStats, passTotals, pathLabels) ? "Wrote camera path summary to " : "Could not write camera path summary to ") << options->statsPath << "\n";
+        return;
+    }
+    if (options->statsPath.empty())
+        return;
+    if (stats.WriteJson(options->statsPath, labels))
+        std::cout << "Wrote frame statistics to " << options->statsPath << "\n";
+    else
+        std::cout << "Could not write frame statistics to " << options->statsPath << "\n";
 }
 
-int main()
+int main(int argc, char* argv[])
 {
-    std::atomic<bool> stillRunning = true;
-    std::atomic<bool> ready        = false;
+    Options options;
+    if (!ParseArguments(argc, argv, options))
+        return 1;
+    Profiler::SetEnabled(!options.tracePath.empty());
 
-    // Start rendering
-    std::thread renderThread(doRendering, &stillRunning, &ready);
-    while (!ready) {}
-    std::cout << "Ready!\n";
+    // The render thread keeps one hardware thread, the main thread is worker 0 of the rest.
+    JobSystem jobSystem;
+    jobSystem.Start(std::max(2u, std::thread::hardware_concurrency()) - 1);
 
-    while (stillRunning) {}
+    // Start rendering, the main thread works on jobs until it is done.
+    std::thread renderThread([&]() {
+        Profiler::SetThreadName("Render");
+        doRendering(&jobSystem, &options);
+        jobSystem.Stop();
+    });
+    jobSystem.Work();
     renderThread.join();
+    // Written once rendering finished, so the trace covers the whole run.
+    if (!options.tracePath.empty()) {
+        if (Profiler::WriteChromeTrace(options.tracePath))
+            std::cout << "Wrote CPU trace to " << options.tracePath << "\n";
+        else
+            std::cout << "Could not write CPU trace to " << options.tracePath << "\n";
+    }
 	return 0;
 }
\ No newline at end of file
@@ -2,17 +2,22 @@
 #define _COMMON_H_
 
 struct Meshlet {
+	uint vertexBase;
+	// In 16-bit entries of the meshlet vertex buffer.
 	uint vertexOffset;
 	uint triangleOffset;
-	uint vertexCount;
-	uint triangleCount;
+	// Vertex count in bits 0-7, triangle count in bits 8-15, MESHLET_WIDE_VERTICES and the material from MESHLET_MATERIAL_SHIFT on.
+	uint counts;
 };
+// Vertex references of this meshlet are absolute 32-bit indices split into two 16-bit halves.
+const uint MESHLET_WIDE_VERTICES = 1u << 16;
+const uint MESHLET_MATERIAL_SHIFT = 17;
 
 struct MeshView {
 	int start;
 	int end;
 	int material;
-	int filler;
+	int meshletCount;
 };
 
 struct SceneInfo {
@@ -20,13 +25,29 @@ struct SceneInfo {
 	uint pointLightCount;
 	uint spotLightCount;
 	uint directionLightCount;
+	uint meshletCount;
+	uint renderFlags;
+	uint frameNumber;
+	uint textureCount;
 };
+const uint RENDER_FORCE_TEXTURE_SAMPLING = 1u << 0;
+// Texture feedback holds the requested level relative to the bound view plus this bias.
+const float FEEDBACK_LOD_BIAS = 16.0;
 
+// Texture indices are only valid when their bit in flags is set, otherwise the factor alone is used.
 struct Material {
 	uint diffuse;
 	uint metallicRoughness;
-	uint emmisive;
+	uint emissive;
+	uint flags;
+	uint baseColorFactor;
+	float metallicFactor;
+	float roughnessFactor;
+	uint emissiveFactor;
 };
+const uint MATERIAL_HAS_DIFFUSE            = 1u << 0;
+const uint MATERIAL_HAS_METALLIC_ROUGHNESS = 1u << 1;
+const uint MATERIAL_HAS_EMISSIVE           = 1u << 2;
 
 struct Vertex {
 	vec3 Position;
@@ -59,6 +80,69 @@ struct SpotLight {
 	float fillerB;
 };
 
+// Scene buffers, all reached through device addresses.
+layout(buffer_reference, std430) readonly buffer MeshletBuffer{ 
+	Meshlet meshlets[];
+};
+layout(buffer_reference, std430) readonly buffer MeshletVertexBuffer{ 
+	uint meshletVertices[];
+};
+layout(buffer_reference, std430) readonly buffer MeshletTriangleBuffer{ 
+	uint meshletTriangles[];
+};
+
+layout(buffer_reference, std430) readonly buffer VertexBuffer{ 
+	Vertex vertices[];
+};
+layout(buffer_reference, std430) readonly buffer MaterialBuffer{
+	Material materials[];
+};
+layout(buffer_reference, std430) readonly buffer PointLightBuffer{
+	PointLight pointLights[];
+};
+layout(buffer_reference, std430) readonly buffer DirLightBuffer{
+	DirLight dirLights[];
+};
+layout(buffer_reference, std430) readonly buffer SpotLightBuffer{
+	SpotLight spotLights[];
+};
+layout(buffer_reference, std430) readonly buffer MeshViewBuffer{
+	MeshView meshViews[];
+};
+layout(buffer_reference, std430) buffer FeedbackBuffer{
+	uint requestedLods[];
+};
+
+// Uploaded once, matches SceneAddresses.
+layout(buffer_reference, std430) readonly buffer SceneAddressBuffer{
+	MeshletBuffer meshletBuffer;
+	MeshletVertexBuffer meshletVertices;
+	MeshletTriangleBuffer meshletTriangles;
+
+	MeshViewBuffer meshViewBuffer;
+	VertexBuffer vertexBuffer;
+	MaterialBuffer materialBuffer;
+
+	PointLightBuffer pointLightBuffer;
+	SpotLightBuffer spotLightBuffer;
+	DirLightBuffer dirLightBuffer;
+};
+// This frame's slot of the constants ring, matches FrameConstants.
+layout(buffer_reference, std430) readonly buffer FrameConstantBuffer{
+	mat4 projView;
+	mat4 worldTransform;
+	SceneInfo sceneInfo;
+
+	SceneAddressBuffer scene;
+	FeedbackBuffer feedbackBuffer;
+};
+layout(push_constant, std430) uniform constant
+{
+	FrameConstantBuffer frame;
+	// First meshlet of the chunk a secondary command buffer draws.
+	uint meshletOffset;
+};
+
 const float PI = 3.14159265359;
 const float PIinv = 1 / PI;
 
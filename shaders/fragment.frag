@@ -14,52 +14,13 @@ layout(location = 4) in vec3 normal;
 
 layout(set = 0, binding = 0) uniform sampler2D textures[];
 
-layout(buffer_reference, std430) readonly buffer MeshletBuffer{ 
-	Meshlet meshlets[];
-};
-layout(buffer_reference, std430) readonly buffer MeshletVertexBuffer{ 
-	uint meshletVertices[];
-};
-layout(buffer_reference, std430) readonly buffer MeshletTriangleBuffer{ 
-	uint8_t meshletTriangles[];
-};
-
-layout(buffer_reference, std430) readonly buffer VertexBuffer{ 
-	Vertex vertices[];
-};
-layout(buffer_reference, std430) readonly buffer MaterialBuffer{
-	Material materials[];
-};
-layout(buffer_reference, std430) readonly buffer PointLightBuffer{
-	PointLight pointLights[];
-};
-layout(buffer_reference, std430) readonly buffer DirLightBuffer{
-	DirLight dirLights[];
-};
-layout(buffer_reference, std430) readonly buffer SpotLightBuffer{
-	SpotLight spotLights[];
-};
-layout(buffer_reference, std430) readonly buffer MeshViewBuffer{
-	MeshView meshViews[];
-};
-layout(push_constant, std430) uniform constant
-{
-	mat4 projView;
-	mat4 worldTransform;
-	SceneInfo sceneInfo;
-
-	MeshletBuffer meshletBuffer;
-	MeshletVertexBuffer meshletVertices;
-	MeshletTriangleBuffer meshletTriangles;
-
-	MeshViewBuffer meshViewBuffer;
-	VertexBuffer vertexBuffer;
-	MaterialBuffer materialBuffer;
-
-	PointLightBuffer pointLightBuffer;
-	SpotLightBuffer spotLightBuffer;
-	DirLightBuffer dirLightBuffer;
-};
+// Reports the level this fragment wants relative to the bound view, the CPU streams in whatever is finer than what is resident.
+// Taken from the derivatives, textureQueryLod and the sampler would clamp it to the resident levels, so nothing finer could ever be asked for.
+void WriteFeedback(uint textureIndex) {
+	vec2 size = vec2(textureSize(textures[nonuniformEXT(textureIndex)], 0));
+	float lod = log2(max(length(dFdx(uv) * size), length(dFdy(uv) * size)));
+	atomicMin(frame.feedbackBuffer.requestedLods[textureIndex], uint(clamp(lod + FEEDBACK_LOD_BIAS, 0.0, 31.0)));
+}
 
 vec3 CalcPointLight(PointLight light, vec3 V, vec3 N, vec3 albedo, vec4 metallicRoughness) {
 	vec3 L = normalize(light.pos - V);
@@ -155,30 +116,51 @@ void main() {
 // Implement range discard for each point and spot light.
 // TODO: Forward+
 // TODO: further optimize shader to use MAD instructions and built in operators
-	Material mat = materialBuffer.materials[materialIndex];
+	Material mat = frame.scene.materialBuffer.materials[materialIndex];
+	// Flat per primitive, so a whole quad takes the same branches and derivatives stay valid.
+	uint textureFlags = mat.flags;
+	if((frame.sceneInfo.renderFlags & RENDER_FORCE_TEXTURE_SAMPLING) != 0)
+		textureFlags = MATERIAL_HAS_DIFFUSE | MATERIAL_HAS_METALLIC_ROUGHNESS | MATERIAL_HAS_EMISSIVE;
+	
+	// Only one quad in 16 reports each frame, rotating with the frame number so every quad reports over time.
+	// Whole quads take the branch, which keeps the derivatives of textureQueryLod valid.
+	uvec2 quad = uvec2(gl_FragCoord.xy) >> 1;
+	if(((quad.x + quad.y * 4 + frame.sceneInfo.frameNumber) & 15) == 0) {
+		if((mat.flags & MATERIAL_HAS_DIFFUSE) != 0)
+			WriteFeedback(mat.diffuse);
+		if((mat.flags & MATERIAL_HAS_METALLIC_ROUGHNESS) != 0)
+			WriteFeedback(mat.metallicRoughness);
+		if((mat.flags & MATERIAL_HAS_EMISSIVE) != 0)
+			WriteFeedback(mat.emissive);
+	}
 	
 	vec3 fragment = vec3(0);
 	vec3 N = normalize(normal);
-	vec4 difFrag = texture(textures[mat.diffuse], uv);
-	vec4 metallicRoughness = texture(textures[mat.metallicRoughness], uv);
+	vec4 difFrag = unpackUnorm4x8(mat.baseColorFactor);
+	if((textureFlags & MATERIAL_HAS_DIFFUSE) != 0)
+		difFrag *= texture(textures[nonuniformEXT(mat.diffuse)], uv);
+	// Roughness in y and metallic in z, like the glTF texture.
+	vec4 metallicRoughness = vec4(1, mat.roughnessFactor, mat.metallicFactor, 1);
+	if((textureFlags & MATERIAL_HAS_METALLIC_ROUGHNESS) != 0)
+		metallicRoughness *= texture(textures[nonuniformEXT(mat.metallicRoughness)], uv);
 
-	mat4 normalTransform = transpose(inverse(worldTransform));
+	mat4 normalTransform = transpose(inverse(frame.worldTransform));
 
 	// Lighting calculations.
 	// Possibly move updates of light positions and normals to a compute shader.
-	for(int i = 0; i < sceneInfo.pointLightCount; i++) {
-			PointLight pointLight = pointLightBuffer.pointLights[i];
-			pointLight.pos = (worldTransform * vec4(pointLight.pos, 1)).xyz;
+	for(int i = 0; i < frame.sceneInfo.pointLightCount; i++) {
+			PointLight pointLight = frame.scene.pointLightBuffer.pointLights[i];
+			pointLight.pos = (frame.worldTransform * vec4(pointLight.pos, 1)).xyz;
 			fragment += CalcPointLight(pointLight, pos, N, difFrag.xyz, metallicRoughness);
 	}
-	for(int i = 0; i < sceneInfo.spotLightCount; i++) {
-			SpotLight spotLight = spotLightBuffer.spotLights[i];
-			spotLight.pos = (worldTransform * vec4(spotLight.pos, 1)).xyz;
+	for(int i = 0; i < frame.sceneInfo.spotLightCount; i++) {
+			SpotLight spotLight = frame.scene.spotLightBuffer.spotLights[i];
+			spotLight.pos = (frame.worldTransform * vec4(spotLight.pos, 1)).xyz;
 			spotLight.lightDir = normalTransform * spotLight.lightDir;
 			fragment += CalcSpotLight(spotLight, pos, N, difFrag.xyz, metallicRoughness);
 	}
-	for(int i = 0; i < sceneInfo.directionLightCount; i++) {
-			DirLight dirLight = dirLightBuffer.dirLights[i];
+	for(int i = 0; i < frame.sceneInfo.directionLightCount; i++) {
+			DirLight dirLight = frame.scene.dirLightBuffer.dirLights[i];
 			dirLight.lightDir = normalTransform * dirLight.lightDir;
 			fragment += CalcDirLight(dirLight, pos, N, difFrag.xyz, metallicRoughness);
 	}
@@ -188,6 +170,8 @@ void main() {
 	fragment = pow(fragment, vec3(1.0/2.2));
 	
 	// Add emissive to final pixel.
-	vec4 emissiveFrag = texture(textures[mat.emmisive], uv);
+	vec4 emissiveFrag = unpackUnorm4x8(mat.emissiveFactor);
+	if((textureFlags & MATERIAL_HAS_EMISSIVE) != 0)
+		emissiveFrag *= texture(textures[nonuniformEXT(mat.emissive)], uv);
 	outColor = mix(vec4(fragment, 1), emissiveFrag, dot(emissiveFrag.xyz, vec3(1)));
 }
\ No newline at end of file